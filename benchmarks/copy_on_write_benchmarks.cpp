@@ -0,0 +1,344 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+#include <stlab/atomic_copy_on_write.hpp>
+#include <stlab/copy_on_write.hpp>
+#include <stlab/cow_map.hpp>
+#include <stlab/cow_vector.hpp>
+#include <stlab/inline_copy_on_write.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using stlab::copy_on_write;
+
+namespace {
+
+// Payload sizes from the range the documentation recommends copy-on-write for.
+constexpr std::int64_t min_payload = 4 << 10;
+constexpr std::int64_t max_payload = 1 << 20;
+
+using buffer = std::vector<std::byte>;
+
+template <class... Policies>
+void copy_destroy(benchmark::State& state) {
+    copy_on_write<buffer, Policies...> source{buffer(64)};
+
+    for (auto _ : state) {
+        copy_on_write<buffer, Policies...> copy(source);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(copy_destroy)->Name("copy_destroy/multi_threaded");
+BENCHMARK(copy_destroy<stlab::single_threaded>)->Name("copy_destroy/single_threaded");
+
+void copy_destroy_default(benchmark::State& state) {
+    for (auto _ : state) {
+        copy_on_write<buffer> x;
+        copy_on_write<buffer> copy(x);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(copy_destroy_default);
+
+// Copying and writing a small value, shared by copy_on_write or stored inline.
+template <class CopyOnWrite>
+void copy_write_small(benchmark::State& state) {
+    CopyOnWrite source(std::int64_t{1});
+
+    for (auto _ : state) {
+        CopyOnWrite copy(source);
+        copy.write() += 1;
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(copy_write_small<copy_on_write<std::int64_t>>)->Name("copy_write_small/copy_on_write");
+BENCHMARK(copy_write_small<stlab::small_copy_on_write<std::int64_t>>)
+    ->Name("copy_write_small/small_copy_on_write");
+
+// Each iteration shares the value and then writes to it, paying for a full copy of the payload.
+// With stlab::recycled_models the copy is assigned into the model and buffer released by the
+// previous iteration rather than allocated.
+template <class... Policies>
+void write_detach(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    copy_on_write<buffer, Policies...> source{buffer(size)};
+
+    for (auto _ : state) {
+        copy_on_write<buffer, Policies...> copy(source);
+        copy.write()[0] = std::byte{1};
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(write_detach)->RangeMultiplier(4)->Range(min_payload, max_payload);
+BENCHMARK(write_detach<stlab::recycled_models<>>)
+    ->Name("write_detach/recycled_models")
+    ->RangeMultiplier(4)
+    ->Range(min_payload, max_payload);
+
+// Ordering two distinct values that differ only in their last element. With
+// stlab::bitwise_compare the equal prefix is skipped with memcmp.
+template <class... Policies>
+void compare_less(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0)) / sizeof(std::uint32_t);
+    copy_on_write<std::vector<std::uint32_t>, Policies...> x{std::vector<std::uint32_t>(size, 1)};
+    copy_on_write<std::vector<std::uint32_t>, Policies...> y{x.read()};
+    y.write().back() = 2;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x < y);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(compare_less)->RangeMultiplier(4)->Range(min_payload, max_payload);
+BENCHMARK(compare_less<stlab::bitwise_compare>)
+    ->Name("compare_less/bitwise_compare")
+    ->RangeMultiplier(4)
+    ->Range(min_payload, max_payload);
+
+// The baseline for write_detach: write() to a unique value is done in place.
+void write_unique(benchmark::State& state) {
+    copy_on_write<buffer> x{buffer(static_cast<std::size_t>(state.range(0)))};
+
+    for (auto _ : state) {
+        x.write()[0] = std::byte{1};
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(write_unique)->RangeMultiplier(4)->Range(min_payload, max_payload);
+
+template <class... Policies>
+void unique_check(benchmark::State& state) {
+    copy_on_write<buffer, Policies...> x{buffer(64)};
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(x.unique());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(unique_check)->Name("unique_check/multi_threaded");
+BENCHMARK(unique_check<stlab::single_threaded>)->Name("unique_check/single_threaded");
+
+// All threads copy and destroy the same value, contending for its reference count.
+void contended_copy(benchmark::State& state) {
+    static copy_on_write<buffer> source{buffer(64)};
+
+    for (auto _ : state) {
+        copy_on_write<buffer> copy(source);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(contended_copy)->ThreadRange(1, 64)->UseRealTime();
+
+// Inserting at the front of a shared vector, either by copying then inserting with write(), or by
+// building the result directly with write(transform, inplace).
+void insert_write(benchmark::State& state) {
+    copy_on_write<buffer> source{buffer(static_cast<std::size_t>(state.range(0)))};
+
+    for (auto _ : state) {
+        copy_on_write<buffer> copy(source);
+        auto& value = copy.write();
+        value.insert(value.begin(), std::byte{1});
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(insert_write)->RangeMultiplier(4)->Range(min_payload, max_payload);
+
+void insert_write_transform(benchmark::State& state) {
+    copy_on_write<buffer> source{buffer(static_cast<std::size_t>(state.range(0)))};
+
+    for (auto _ : state) {
+        copy_on_write<buffer> copy(source);
+        copy.write(
+            [](const buffer& value) {
+                buffer result;
+                result.reserve(value.size() + 1);
+                result.push_back(std::byte{1});
+                result.insert(result.end(), value.begin(), value.end());
+                return result;
+            },
+            [](buffer& value) { value.insert(value.begin(), std::byte{1}); });
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(insert_write_transform)->RangeMultiplier(4)->Range(min_payload, max_payload);
+
+// Detaching every element of a shared collection, one write() at a time or with write_all().
+template <bool Batched>
+void write_collection(benchmark::State& state) {
+    const auto count = static_cast<std::size_t>(state.range(0));
+    std::vector<copy_on_write<int>> source(count, copy_on_write<int>{0});
+
+    for (auto _ : state) {
+        auto values = source;
+        if constexpr (Batched) {
+            stlab::write_all(values, [](int& value) { ++value; });
+        } else {
+            for (auto& e : values) ++e.write();
+        }
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(write_collection<false>)->Name("write_collection/write")->Range(8, 4096);
+BENCHMARK(write_collection<true>)->Name("write_collection/write_all")->Range(8, 4096);
+
+// Detaching a large array, copying it on a thread for each of range(1) chunks.
+void write_detach_parallel(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    const auto chunks = static_cast<std::size_t>(state.range(1));
+    copy_on_write<std::byte[]> source(size);
+    std::vector<std::thread> threads;
+    auto executor = [&](auto task) { threads.emplace_back(std::move(task)); };
+
+    for (auto _ : state) {
+        copy_on_write<std::byte[]> copy(source);
+        copy.write(executor, size / chunks)[0] = std::byte{1};
+        for (auto& e : threads) e.join();
+        threads.clear();
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(write_detach_parallel)
+    ->ArgsProduct({{max_payload, 64 * max_payload}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+// Writing one element of a shared sequence, which copies the whole vector for a copy_on_write
+// but only one page and the page table for a cow_vector.
+void write_element_vector(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    copy_on_write<std::vector<int>> source{std::vector<int>(size)};
+
+    for (auto _ : state) {
+        copy_on_write<std::vector<int>> copy(source);
+        copy.write()[size / 2] = 1;
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(write_element_vector)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+void write_element_cow_vector(benchmark::State& state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    stlab::cow_vector<int> source(size);
+
+    for (auto _ : state) {
+        stlab::cow_vector<int> copy(source);
+        copy.write(size / 2) = 1;
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(write_element_cow_vector)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+// Inserting one element into a shared snapshot of a map, as an undo history does, which copies
+// the whole map for a copy_on_write but only the path to the element for a cow_map.
+void insert_snapshot_map(benchmark::State& state) {
+    const auto size = static_cast<int>(state.range(0));
+    std::map<int, int> elements;
+    for (int n = 0; n != size; ++n) elements.emplace(n, n);
+    copy_on_write<std::map<int, int>> source{std::move(elements)};
+
+    for (auto _ : state) {
+        copy_on_write<std::map<int, int>> copy(source);
+        copy.write().emplace(size, size);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(insert_snapshot_map)->RangeMultiplier(16)->Range(1 << 4, 1 << 16);
+
+void insert_snapshot_cow_map(benchmark::State& state) {
+    const auto size = static_cast<int>(state.range(0));
+    stlab::cow_map<int, int> source;
+    for (int n = 0; n != size; ++n) source.insert({n, n});
+
+    for (auto _ : state) {
+        stlab::cow_map<int, int> copy(source);
+        copy.insert({size, size});
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(insert_snapshot_cow_map)->RangeMultiplier(16)->Range(1 << 4, 1 << 16);
+
+// Readers loading a published snapshot, from a copy_on_write guarded by a mutex or from an
+// atomic_copy_on_write.
+void load_snapshot_mutex(benchmark::State& state) {
+    static std::mutex mutex;
+    static copy_on_write<buffer> published{buffer(64)};
+
+    for (auto _ : state) {
+        copy_on_write<buffer> snapshot = [] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return published;
+        }();
+        benchmark::DoNotOptimize(snapshot);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(load_snapshot_mutex)->ThreadRange(1, 64)->UseRealTime();
+
+void load_snapshot_atomic(benchmark::State& state) {
+    static stlab::atomic_copy_on_write<buffer> published{copy_on_write<buffer>(buffer(64))};
+
+    for (auto _ : state) {
+        copy_on_write<buffer> snapshot = published.load();
+        benchmark::DoNotOptimize(snapshot);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(load_snapshot_atomic)->ThreadRange(1, 64)->UseRealTime();
+
+// Readers borrowing the published snapshot, which does not write to its reference count.
+void borrow_snapshot_atomic(benchmark::State& state) {
+    static stlab::atomic_copy_on_write<buffer> published{copy_on_write<buffer>(buffer(64))};
+
+    for (auto _ : state) {
+        auto snapshot = published.borrow();
+        benchmark::DoNotOptimize(snapshot->data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(borrow_snapshot_atomic)->ThreadRange(1, 64)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
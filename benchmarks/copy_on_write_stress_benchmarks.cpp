@@ -0,0 +1,170 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+
+/*
+    Multi-threaded stress benchmarks for copy_on_write. Each benchmark sweeps the thread count
+    over operations that contend for shared state and reports, besides throughput, the median and
+    tail latency of an operation. Each benchmark also checks the shared value once all threads are
+    done, and fails if a reference was lost or the value was corrupted.
+
+    With Google Benchmark built against libpfm (-DBENCHMARK_ENABLE_LIBPFM=ON) hardware counters
+    are reported per iteration with, for example, --benchmark_perf_counters=CYCLES,CACHE-MISSES.
+*/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using stlab::copy_on_write;
+
+namespace {
+
+using buffer = std::vector<std::byte>;
+
+// Operations are timed in batches, as a single operation is close to the resolution of the clock.
+constexpr std::size_t batch = 64;
+
+constexpr int max_threads = 64;
+
+/*
+    Records the time of each batch of operations on one thread and reports the percentiles of
+    the time per operation, averaged over the threads.
+*/
+class latency {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<double> _samples;
+    clock::time_point _start;
+
+    auto percentile(double p) -> double {
+        auto n = static_cast<std::size_t>(p * static_cast<double>(_samples.size() - 1));
+        std::nth_element(_samples.begin(), _samples.begin() + n, _samples.end());
+        return _samples[n] / static_cast<double>(batch);
+    }
+
+public:
+    latency() { _samples.reserve(1 << 16); }
+
+    void start() { _start = clock::now(); }
+
+    void stop() {
+        _samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - _start).count());
+    }
+
+    void report(benchmark::State& state) {
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(batch));
+        if (_samples.empty()) return;
+
+        constexpr auto average = benchmark::Counter::kAvgThreads;
+        state.counters["p50_ns"] = benchmark::Counter(percentile(0.5), average);
+        state.counters["p99_ns"] = benchmark::Counter(percentile(0.99), average);
+        state.counters["p999_ns"] = benchmark::Counter(percentile(0.999), average);
+    }
+};
+
+// All threads copy and destroy instances sharing one value, contending for its reference count.
+template <class... Policies>
+void stress_copy_destroy(benchmark::State& state) {
+    static copy_on_write<buffer, Policies...> source{buffer(64, std::byte{1})};
+    latency timer;
+
+    for (auto _ : state) {
+        timer.start();
+        for (std::size_t i = 0; i != batch; ++i) {
+            copy_on_write<buffer, Policies...> copy(source);
+            benchmark::DoNotOptimize(copy);
+        }
+        timer.stop();
+    }
+    timer.report(state);
+
+    if (state.thread_index() == 0 && source.use_count() != 1) {
+        state.SkipWithError("reference count of the shared value was corrupted");
+    }
+}
+
+BENCHMARK(stress_copy_destroy)
+    ->Name("stress_copy_destroy")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+BENCHMARK(stress_copy_destroy<stlab::padded_count<>>)
+    ->Name("stress_copy_destroy/padded_count")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+
+// All threads copy a common source and write to the copy, each write detaching a new value.
+template <class... Policies>
+void stress_write_detach(benchmark::State& state) {
+    static copy_on_write<buffer, Policies...> source{buffer(4 << 10, std::byte{1})};
+    latency timer;
+
+    for (auto _ : state) {
+        timer.start();
+        for (std::size_t i = 0; i != batch; ++i) {
+            copy_on_write<buffer, Policies...> copy(source);
+            copy.write()[0] = std::byte{2};
+            benchmark::DoNotOptimize(copy);
+        }
+        timer.stop();
+    }
+    timer.report(state);
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(batch * source->size()));
+
+    if (state.thread_index() == 0 && (source.use_count() != 1 || (*source)[0] != std::byte{1})) {
+        state.SkipWithError("the shared source was modified");
+    }
+}
+
+BENCHMARK(stress_write_detach)
+    ->Name("stress_write_detach")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+BENCHMARK(stress_write_detach<stlab::recycled_models<>>)
+    ->Name("stress_write_detach/recycled_models")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+
+// All threads default construct, copy and destroy instances, which share the default model.
+template <class T>
+void stress_default_churn(benchmark::State& state) {
+    latency timer;
+
+    for (auto _ : state) {
+        timer.start();
+        for (std::size_t i = 0; i != batch; ++i) {
+            copy_on_write<T> x;
+            copy_on_write<T> y(x);
+            benchmark::DoNotOptimize(y);
+        }
+        timer.stop();
+    }
+    timer.report(state);
+
+    if (state.thread_index() == 0 && copy_on_write<T>().read() != T()) {
+        state.SkipWithError("the default value was modified");
+    }
+}
+
+// A trivially destructible value has a constant initialized default model; a string does not.
+BENCHMARK(stress_default_churn<std::int64_t>)
+    ->Name("stress_default_churn/int64_t")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+BENCHMARK(stress_default_churn<std::string>)
+    ->Name("stress_default_churn/string")
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,501 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file atomic_copy_on_write.hpp
+    @brief Atomic access to a shared copy_on_write
+
+    This file contains the implementation of stlab::atomic_copy_on_write, a copy_on_write that
+    may be loaded and stored concurrently from multiple threads without a lock, and of the hazard
+    pointers it uses to reclaim replaced values.
+*/
+
+#ifndef STLAB_ATOMIC_COPY_ON_WRITE_HPP
+#define STLAB_ATOMIC_COPY_ON_WRITE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    A hazard pointer. A thread publishes in a record the model it is about to acquire a reference
+    to, and a model is not released while a record refers to it. Records are never freed; they
+    are reused once the thread holding them releases them or exits.
+*/
+struct hazard_record {
+    std::atomic<const void*> _pointer{nullptr};
+    std::atomic<bool> _active{true};
+    hazard_record* _next{nullptr};
+};
+
+/*
+    A reference retired by a store, released with `reclaim` once no hazard pointer refers to it.
+*/
+struct retired_pointer {
+    void* _pointer;
+    void (*_reclaim)(void*) noexcept;
+};
+
+/*
+    References still protected when the thread that retired them exited.
+*/
+struct retired_batch {
+    std::vector<retired_pointer> _pointers;
+    retired_batch* _next{nullptr};
+};
+
+class hazard_domain {
+    std::atomic<hazard_record*> _records{nullptr};
+    std::atomic<std::size_t> _record_count{0};
+    std::atomic<retired_batch*> _orphans{nullptr};
+
+    auto is_protected(const void* p) const noexcept -> bool {
+        for (hazard_record* r = _records.load(std::memory_order_acquire); r; r = r->_next) {
+            if (r->_pointer.load(std::memory_order_acquire) == p) return true;
+        }
+        return false;
+    }
+
+    /*
+        Releases the references in `retired` that are not protected, compacting the rest to the
+        front. Must follow a sequentially consistent fence so a reader that saw a retired
+        reference still published has its hazard pointer observed.
+    */
+    void release_unprotected(std::vector<retired_pointer>& retired) const noexcept {
+        auto out = retired.begin();
+        for (auto& e : retired) {
+            if (is_protected(e._pointer)) {
+                *out++ = e;
+            } else {
+                e._reclaim(e._pointer);
+            }
+        }
+        retired.erase(out, retired.end());
+    }
+
+    void push_orphans(retired_batch* batch) noexcept {
+        batch->_next = _orphans.load(std::memory_order_relaxed);
+        while (!_orphans.compare_exchange_weak(batch->_next, batch, std::memory_order_release,
+                                               std::memory_order_relaxed)) {}
+    }
+
+public:
+    /*
+        Returns an inactive record, or a new one if every record is in use.
+    */
+    auto acquire() -> hazard_record* {
+        for (hazard_record* r = _records.load(std::memory_order_acquire); r; r = r->_next) {
+            if (!r->_active.load(std::memory_order_relaxed) &&
+                !r->_active.exchange(true, std::memory_order_acquire)) {
+                return r;
+            }
+        }
+        auto* r = new hazard_record;
+        r->_next = _records.load(std::memory_order_relaxed);
+        while (!_records.compare_exchange_weak(r->_next, r, std::memory_order_release,
+                                               std::memory_order_relaxed)) {}
+        _record_count.fetch_add(1, std::memory_order_relaxed);
+        return r;
+    }
+
+    static void release(hazard_record* r) noexcept {
+        r->_pointer.store(nullptr, std::memory_order_release);
+        r->_active.store(false, std::memory_order_release);
+    }
+
+    [[nodiscard]] auto record_count() const noexcept -> std::size_t {
+        return _record_count.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Releases the unprotected references in `retired`, and in batches left by exited threads.
+    */
+    void scan(std::vector<retired_pointer>& retired) noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        release_unprotected(retired);
+
+        retired_batch* orphans = _orphans.exchange(nullptr, std::memory_order_acquire);
+        while (orphans) {
+            retired_batch* next = orphans->_next;
+            release_unprotected(orphans->_pointers);
+            if (orphans->_pointers.empty()) {
+                delete orphans;
+            } else {
+                push_orphans(orphans);
+            }
+            orphans = next;
+        }
+    }
+
+    /*
+        Releases `p` if no hazard pointer refers to it, otherwise hands it to the domain to be
+        released by a later scan. Unlike hazard_thread::retire() this does not use the state of
+        the current thread, so it may be called during static destruction. If the batch cannot
+        be allocated the reference is leaked.
+    */
+    void retire(void* p, void (*reclaim)(void*) noexcept) noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!is_protected(p)) {
+            reclaim(p);
+            return;
+        }
+        try {
+            push_orphans(new retired_batch{{{p, reclaim}}});
+        } catch (...) {
+        }
+    }
+
+    /*
+        Hands the references of an exiting thread to the domain, to be released by a later scan.
+        If the batch cannot be allocated the references are leaked.
+    */
+    void orphan(std::vector<retired_pointer>&& retired) noexcept {
+        if (retired.empty()) return;
+        try {
+            push_orphans(new retired_batch{std::move(retired)});
+        } catch (...) {
+        }
+    }
+};
+
+/*
+    The domain shared by all atomic_copy_on_write objects. It is never destroyed, so threads
+    exiting during static destruction can still return their records to it.
+*/
+inline auto hazard_pointers() -> hazard_domain& {
+    static hazard_domain& domain = *new hazard_domain;
+    return domain;
+}
+
+/*
+    The records and retired references of the current thread.
+*/
+class hazard_thread {
+    std::vector<hazard_record*> _free;
+    std::size_t _owned{0};
+    std::vector<retired_pointer> _retired;
+
+public:
+    hazard_thread() = default;
+    hazard_thread(const hazard_thread&) = delete;
+    auto operator=(const hazard_thread&) -> hazard_thread& = delete;
+
+    ~hazard_thread() {
+        for (hazard_record* r : _free) hazard_domain::release(r);
+        hazard_pointers().scan(_retired);
+        hazard_pointers().orphan(std::move(_retired));
+    }
+
+    auto acquire() -> hazard_record* {
+        if (!_free.empty()) {
+            hazard_record* r = _free.back();
+            _free.pop_back();
+            return r;
+        }
+        _free.reserve(_owned + 1);
+        hazard_record* r = hazard_pointers().acquire();
+        ++_owned;
+        return r;
+    }
+
+    /*
+        Returns a record to the thread. The capacity reserved by acquire() ensures this does not
+        allocate.
+    */
+    void release(hazard_record* r) noexcept {
+        r->_pointer.store(nullptr, std::memory_order_release);
+        _free.push_back(r);
+    }
+
+    /*
+        Ensures the next call to retire() does not allocate.
+    */
+    void reserve_retire() {
+        if (_retired.size() == _retired.capacity()) _retired.reserve(2 * _retired.size() + 64);
+    }
+
+    void retire(void* p, void (*reclaim)(void*) noexcept) noexcept {
+        _retired.push_back({p, reclaim});
+        if (_retired.size() >= 2 * hazard_pointers().record_count() + 64) {
+            hazard_pointers().scan(_retired);
+        }
+    }
+};
+
+inline auto this_hazard_thread() -> hazard_thread& {
+    thread_local hazard_thread state;
+    return state;
+}
+
+/*
+    A hazard pointer held by the current thread for the lifetime of the guard.
+*/
+class hazard_guard {
+    hazard_thread& _thread;
+    hazard_record* _record;
+
+public:
+    hazard_guard() : _thread(this_hazard_thread()), _record(_thread.acquire()) {}
+    hazard_guard(const hazard_guard&) = delete;
+    auto operator=(const hazard_guard&) -> hazard_guard& = delete;
+
+    ~hazard_guard() { _thread.release(_record); }
+
+    /*
+        Returns the pointer held by `source`, published in this guard so that it is not released
+        while the guard protects it.
+    */
+    template <class P>
+    auto protect(const std::atomic<P*>& source) noexcept -> P* {
+        P* p = source.load(std::memory_order_relaxed);
+        while (true) {
+            _record->_pointer.store(p, std::memory_order_seq_cst);
+            P* q = source.load(std::memory_order_seq_cst);
+            if (q == p) return p;
+            p = q;
+        }
+    }
+};
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    A copy_on_write<T, Policies...> that may be loaded, stored, exchanged and compared concurrently
+    from multiple threads, the equivalent of `std::atomic<std::shared_ptr<T>>` for copy_on_write.
+    It suits publishing snapshots of a value from a writer to many readers: a reader load()s the
+    current snapshot and a writer builds a new value and store()s it.
+
+    load() is lock-free. The reference held by the atomic object is protected with a hazard
+    pointer while the reader acquires its own, so a reference replaced by a store is released
+    only once no reader is acquiring it. Replaced references are released in batches by the
+    thread that replaced them, or by a later store on any thread if readers still protected them
+    when that thread exited. A replaced value is therefore destroyed some time after the store
+    rather than during it.
+
+    A reader that only needs the value for a short time can borrow() it instead, which protects
+    the value with a hazard pointer alone and does not write to its reference count.
+
+    Compare and exchange operations compare identity(), not the values.
+
+    The threading policy must be stlab::multi_threaded.
+*/
+template <class T, class... Policies>
+class atomic_copy_on_write {
+public:
+    /*!
+        The type of copy_on_write stored.
+    */
+    using value_type = copy_on_write<T, Policies...>;
+
+private:
+    static_assert(std::is_same_v<typename value_type::threading, multi_threaded>,
+                  "atomic_copy_on_write requires the multi_threaded policy");
+
+    using model = std::remove_pointer_t<decltype(std::declval<value_type&>()._self)>;
+    using observer = typename value_type::observer;
+
+    std::atomic<model*> _self;
+
+    static void reclaim(void* p) noexcept {
+        value_type released(value_type::adopt, static_cast<model*>(p));
+    }
+
+    static auto release(value_type& x) noexcept -> model* {
+        assert(x._self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return std::exchange(x._self, nullptr);
+    }
+
+    /*
+        Installs `desired` with `exchange`, which compares and exchanges the stored model, and
+        retires the reference replaced.
+    */
+    template <class F>
+    auto compare_exchange(value_type& expected, value_type desired, F exchange) -> bool {
+        detail::hazard_thread& thread = detail::this_hazard_thread();
+        thread.reserve_retire();
+        model* e = expected._self;
+        if (exchange(e, desired._self)) {
+            desired._self = nullptr;
+            thread.retire(e, reclaim);
+            return true;
+        }
+        expected = load();
+        return false;
+    }
+
+public:
+    /*!
+        A read-only view of the value stored in an atomic_copy_on_write at the time it was
+        borrowed, see borrow(). The value remains valid while the view exists, even if the
+        atomic_copy_on_write is stored to or destroyed, without holding a reference to it.
+
+        A borrowed view must be destroyed by the thread that borrowed it.
+    */
+    class borrowed {
+        detail::hazard_guard _guard;
+        model* _self;
+
+        friend class atomic_copy_on_write;
+
+        explicit borrowed(const std::atomic<model*>& source) : _self(_guard.protect(source)) {}
+
+    public:
+        borrowed(const borrowed&) = delete;
+        auto operator=(const borrowed&) -> borrowed& = delete;
+
+        /*!
+            Returns a const reference to the borrowed value.
+        */
+        [[nodiscard]] auto read() const noexcept -> const T& { return _self->_value; }
+
+        [[nodiscard]] auto operator*() const noexcept -> const T& { return read(); }
+
+        [[nodiscard]] auto operator->() const noexcept -> const T* { return &read(); }
+
+        /*!
+            Returns a copy_on_write sharing the borrowed value, which outlives the view.
+        */
+        [[nodiscard]] auto copy() const noexcept -> value_type {
+            _self->_count.increment();
+            observer::on_share();
+            return value_type(value_type::adopt, _self);
+        }
+
+        /*!
+            Returns true if `x` shares the borrowed value.
+        */
+        [[nodiscard]] auto identity(const value_type& x) const noexcept -> bool {
+            return _self == x._self;
+        }
+    };
+
+    /*!
+        True if load() and store() never take a lock.
+    */
+    static constexpr bool is_always_lock_free = std::atomic<model*>::is_always_lock_free;
+
+    /*!
+        Stores a default constructed copy_on_write.
+    */
+    atomic_copy_on_write() noexcept(std::is_nothrow_default_constructible_v<value_type>) :
+        atomic_copy_on_write(value_type()) {}
+
+    /*!
+        Stores `x`.
+    */
+    atomic_copy_on_write(value_type x) noexcept : _self(release(x)) {}
+
+    atomic_copy_on_write(const atomic_copy_on_write&) = delete;
+    auto operator=(const atomic_copy_on_write&) -> atomic_copy_on_write& = delete;
+
+    /*!
+        Releases the stored copy_on_write. If it is borrowed, it is released once every view of
+        it has been destroyed.
+    */
+    ~atomic_copy_on_write() {
+        detail::hazard_pointers().retire(_self.load(std::memory_order_relaxed), reclaim);
+    }
+
+    /*!
+        Returns a copy_on_write sharing the stored value.
+    */
+    [[nodiscard]] auto load() const -> value_type {
+        detail::hazard_guard guard;
+        model* p = guard.protect(_self);
+        p->_count.increment();
+        observer::on_share();
+        return value_type(value_type::adopt, p);
+    }
+
+    /*!
+        Returns a view of the stored value.
+
+        Unlike load(), borrowing does not modify the reference count of the value; readers only
+        write to a hazard pointer owned by their thread, so concurrent readers do not contend for
+        the cache line holding the count. A view is intended to be short lived, as a value
+        replaced while borrowed is not destroyed until every view of it is.
+    */
+    [[nodiscard]] auto borrow() const -> borrowed { return borrowed(_self); }
+
+    /*!
+        Replaces the stored copy_on_write with `x`.
+    */
+    void store(value_type x) {
+        detail::hazard_thread& thread = detail::this_hazard_thread();
+        thread.reserve_retire();
+        thread.retire(_self.exchange(release(x), std::memory_order_acq_rel), reclaim);
+    }
+
+    /*!
+        Same as store(), returning `x`.
+    */
+    auto operator=(value_type x) -> value_type {
+        store(x);
+        return x;
+    }
+
+    /*!
+        Replaces the stored copy_on_write with `x`, returning the one replaced.
+    */
+    auto exchange(value_type x) -> value_type {
+        detail::hazard_thread& thread = detail::this_hazard_thread();
+        thread.reserve_retire();
+        model* p = _self.exchange(release(x), std::memory_order_acq_rel);
+        p->_count.increment();
+        thread.retire(p, reclaim);
+        return value_type(value_type::adopt, p);
+    }
+
+    /*!
+        Replaces the stored copy_on_write with `desired` if it is identical to `expected`, and
+        returns true. Otherwise loads the stored copy_on_write into `expected` and returns false.
+    */
+    auto compare_exchange_strong(value_type& expected, value_type desired) -> bool {
+        return compare_exchange(expected, std::move(desired), [&](model*& e, model* d) {
+            return _self.compare_exchange_strong(e, d, std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed);
+        });
+    }
+
+    /*!
+        Same as compare_exchange_strong(), but may fail spuriously.
+    */
+    auto compare_exchange_weak(value_type& expected, value_type desired) -> bool {
+        return compare_exchange(expected, std::move(desired), [&](model*& e, model* d) {
+            return _self.compare_exchange_weak(e, d, std::memory_order_acq_rel,
+                                               std::memory_order_relaxed);
+        });
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
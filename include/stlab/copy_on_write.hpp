@@ -46,8 +46,13 @@
 
     @section features_sec Key Features
 
-    - **Thread-safe**: Uses atomic reference counting for safe concurrent access
+    - **Thread-safe**: Uses atomic reference counting for safe concurrent access, or plain
+      counting with the stlab::single_threaded policy
     - **Header-only**: No compilation required, just include the header
+    - **Allocator-aware**: Values can be allocated from any standard allocator, such as an arena
+      or pool
+    - **Layout control**: Over-aligned values, a padded reference count, and runtime sized arrays
+      (`copy_on_write<T[]>`) stored in a single allocation
     - **C++17**: Leverages modern C++ features for clean, efficient implementation
 
     @section usage_sec Basic Usage
@@ -77,121 +82,2205 @@
 
 /**************************************************************************************************/
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 /**************************************************************************************************/
 
+/*
+    ThreadSanitizer does not model `std::atomic_thread_fence`, so when it is enabled the reference
+    counts acquire on the decrement itself rather than with a fence after the last decrement.
+*/
+#if defined(__SANITIZE_THREAD__)
+#define STLAB_COPY_ON_WRITE_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define STLAB_COPY_ON_WRITE_TSAN 1
+#endif
+#endif
+
+#ifndef STLAB_COPY_ON_WRITE_TSAN
+#define STLAB_COPY_ON_WRITE_TSAN 0
+#endif
+
+/**************************************************************************************************/
+
+/*!
+    The stlab namespace contains utilities and components for modern C++ development.
+*/
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    Policies are identified by a nested `policy_category` type. Any policy without one is taken to
+    be an allocator.
+*/
+struct allocator_policy {};
+struct threading_policy {};
+struct layout_policy {};
+struct instrumentation_policy {};
+struct hashing_policy {};
+struct weak_policy {};
+struct recycling_policy {};
+struct comparison_policy {};
+
+/*
+    The default hashing policy computes the hash of the value each time it is requested.
+*/
+struct uncached_hash {
+    using policy_category = hashing_policy;
+    using hasher = void;
+    static constexpr bool cached = false;
+};
+
+/*
+    By default a model has no weak references.
+*/
+struct no_weak_references {
+    using policy_category = weak_policy;
+    static constexpr bool enabled = false;
+};
+
+/*
+    The default comparison policy compares values with their own operators.
+*/
+struct value_compare {
+    using policy_category = comparison_policy;
+
+    template <class T>
+    static auto equal(const T& x, const T& y) -> bool {
+        return x == y;
+    }
+
+    template <class T>
+    static auto less(const T& x, const T& y) -> bool {
+        return x < y;
+    }
+
+    template <class E>
+    static auto equal(const E* x, std::size_t n, const E* y, std::size_t m) -> bool {
+        return std::equal(x, x + n, y, y + m);
+    }
+
+    template <class E>
+    static auto less(const E* x, std::size_t n, const E* y, std::size_t m) -> bool {
+        return std::lexicographical_compare(x, x + n, y, y + m);
+    }
+};
+
+/*
+    True if `T` is a contiguous range, with `std::data()` and `std::size()`, of elements whose
+    value is determined by their bytes.
+*/
+template <class T>
+using data_pointer_t = decltype(std::data(std::declval<const T&>()));
+
+template <class T, class = void>
+constexpr bool is_bitwise_range_v = false;
+
+template <class T>
+constexpr bool
+    is_bitwise_range_v<T,
+                       std::void_t<decltype(std::size(std::declval<const T&>())),
+                                   std::enable_if_t<std::is_pointer_v<data_pointer_t<T>>>>> =
+        std::has_unique_object_representations_v<
+            std::remove_cv_t<std::remove_pointer_t<data_pointer_t<T>>>>;
+
+template <class T, class = void>
+constexpr bool has_traits_type_v = false;
+
+template <class T>
+constexpr bool has_traits_type_v<T, std::void_t<typename T::traits_type>> = true;
+
+/*
+    The index of the first of `n` elements of `x` and `y` whose bytes differ, or `n`. Equal
+    prefixes are skipped a page and then a cache line at a time with `std::memcmp`.
+*/
+template <class E>
+auto bitwise_mismatch(const E* x, const E* y, std::size_t n) noexcept -> std::size_t {
+    std::size_t i = 0;
+    for (std::size_t bytes : {std::size_t{4096}, std::size_t{64}, sizeof(E)}) {
+        const std::size_t block = std::max<std::size_t>(bytes / sizeof(E), 1);
+        while (n - i >= block && std::memcmp(x + i, y + i, block * sizeof(E)) == 0) i += block;
+    }
+    return i;
+}
+
+/*
+    By default a released model is freed.
+*/
+struct no_recycling {
+    using policy_category = recycling_policy;
+    static constexpr std::size_t capacity = 0;
+};
+
+/*
+    The default layout places the reference count and value adjacent in the model.
+*/
+struct compact_layout {
+    static constexpr std::size_t alignment = 1;
+};
+
+template <class P, class = void>
+struct policy_category {
+    using type = allocator_policy;
+};
+
+template <class P>
+struct policy_category<P, std::void_t<typename P::policy_category>> {
+    using type = typename P::policy_category;
+};
+
+template <class P>
+using policy_category_t = typename policy_category<P>::type;
+
+template <class T>
+struct type_identity {
+    using type = T;
+};
+
+/*
+    Selects the first policy in `Ps` of the given category, or `Default` if there is none.
+*/
+template <class Category, class Default, class... Ps>
+struct select_policy : type_identity<Default> {};
+
+template <class Category, class Default, class P, class... Ps>
+struct select_policy<Category, Default, P, Ps...>
+    : std::conditional_t<std::is_same_v<policy_category_t<P>, Category>,
+                         type_identity<P>,
+                         select_policy<Category, Default, Ps...>> {};
+
+template <class Category, class Default, class... Ps>
+using select_policy_t = typename select_policy<Category, Default, Ps...>::type;
+
+template <class Category, class... Ps>
+constexpr std::size_t count_policy_v =
+    (std::size_t{0} + ... + std::is_same_v<policy_category_t<Ps>, Category>);
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    Threading policy for copy_on_write. The reference count is atomic and copies of a
+    copy_on_write may be used concurrently from multiple threads. This is the default.
+*/
+struct multi_threaded {
+    using policy_category = detail::threading_policy;
+};
+
+/*!
+    Threading policy for copy_on_write. The reference count is a plain integer, avoiding atomic
+    operations. All copies sharing a value must be used from a single thread.
+*/
+struct single_threaded {
+    using policy_category = detail::threading_policy;
+};
+
+/*!
+    Layout policy for copy_on_write. The reference count and the value are each aligned to
+    `Alignment` bytes, typically the cache line size, so the count written by every copy does not
+    share a cache line with the value read by other threads.
+*/
+template <std::size_t Alignment = 64>
+struct padded_count {
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+    using policy_category = detail::layout_policy;
+    static constexpr std::size_t alignment = Alignment;
+};
+
+/*!
+    The events reported by an instrumented copy_on_write. Every event does nothing; an observer
+    derives from this class and hides the events it is interested in with its own static member
+    functions of the same signature.
+
+    The `bytes` reported for a value are given by `size()`, which is `sizeof(T)` unless hidden by
+    the observer, for example to include memory owned by the value. For copy_on_write<T[]> the
+    bytes are the number of elements times `sizeof(T)`.
+*/
+struct copy_on_write_observer {
+    /*!
+        Returns the estimated size of `value`.
+    */
+    template <class T>
+    static auto size(const T&) noexcept -> std::size_t {
+        return sizeof(T);
+    }
+
+    /*!
+        A new value of `bytes` size was constructed by a constructor or by assignment of a value to
+        a shared instance.
+    */
+    static void on_construct(std::size_t /* bytes */) noexcept {}
+
+    /*!
+        An instance was copied, sharing its value.
+    */
+    static void on_share() noexcept {}
+
+    /*!
+        write() copied a shared value of `bytes` size.
+    */
+    static void on_detach(std::size_t /* bytes */) noexcept {}
+
+    /*!
+        write() returned a unique value without copying.
+    */
+    static void on_write_inplace() noexcept {}
+
+    /*!
+        A value was assigned in place to a unique instance.
+    */
+    static void on_assign_inplace() noexcept {}
+
+    /*!
+        The last reference to a value of `bytes` size was released and the value destroyed.
+    */
+    static void on_destroy(std::size_t /* bytes */) noexcept {}
+};
+
+/*!
+    Instrumentation policy for copy_on_write. `Observer`, usually derived from
+    stlab::copy_on_write_observer, is notified of the events described there. Without this policy
+    the events compile to nothing.
+*/
+template <class Observer>
+struct instrumented {
+    using policy_category = detail::instrumentation_policy;
+    using observer = Observer;
+};
+
+/*!
+    Hashing policy for copy_on_write. The hash of the value, computed with `Hash` or `std::hash<T>`
+    if `Hash` is void, is stored in the model the first time hash() is called, and reused until
+    the value is written. Equality comparison of two copy_on_write objects whose hashes are both
+    known and differ returns false without comparing the values.
+
+    As the value of a unique object may be modified through the reference returned by write(),
+    the hash of a value written by write() is not stored until the value is shared again.
+*/
+template <class Hash = void>
+struct cached_hash {
+    using policy_category = detail::hashing_policy;
+    using hasher = Hash;
+    static constexpr bool cached = true;
+};
+
+/*!
+    Weak reference policy for copy_on_write, enabling stlab::weak_copy_on_write. The model holds a
+    second count, of weak references. The value is destroyed when the last copy_on_write referring
+    to it is released, and the model is freed when the last weak reference is released.
+
+    Weak references do not count toward unique(), so holding one never causes write() to copy.
+    Instead, writing a unique value that weak references refer to moves it to a new model and
+    expires the weak references, so a weak reference never observes a write to its value.
+*/
+struct weak_references {
+    using policy_category = detail::weak_policy;
+    static constexpr bool enabled = true;
+};
+
+/*!
+    Recycling policy for copy_on_write. Each thread keeps up to `Capacity` models released by the
+    last copy_on_write referring to them, with their values still constructed. A shared value
+    detached by write(), or a value assigned to a shared instance, is copy or move assigned into a
+    recycled model instead of allocating and constructing a new one, so a value such as a
+    `std::vector` reuses the buffers it already owns.
+
+    This suits objects that are shared and written in turn in a loop. A released value is not
+    destroyed until its model is reused with a new value, evicted when the pool is full, or until
+    the thread exits, so any resources it holds are kept until then.
+
+    Requires a copy assignable value and an allocator whose instances always compare equal, and
+    does not support the weak reference policy.
+*/
+template <std::size_t Capacity = 8>
+struct recycled_models {
+    static_assert(Capacity > 0, "Capacity must be at least one model");
+
+    using policy_category = detail::recycling_policy;
+    static constexpr std::size_t capacity = Capacity;
+};
+
+/*!
+    Comparison policy for copy_on_write. Values are compared for equality by comparing their bytes
+    with `std::memcmp`, which the standard library implements with vector instructions, so
+    comparing large buffers runs at memory bandwidth rather than one element at a time.
+
+    `T` must be either a contiguous range, such as `std::vector`, `std::array` or `std::string`,
+    whose elements have unique object representations, or itself have unique object
+    representations. For a range, ordering skips the equal prefix of the two values with
+    `std::memcmp` and then compares the first differing elements with `<`, or with
+    `traits_type::lt` for a string, so the order is that of `T`. A value that is not a range is
+    ordered with its own `<`.
+
+    Floating point types do not have unique object representations, as `0.0 == -0.0` and a NaN is
+    not equal to itself, so are not supported.
+*/
+struct bitwise_compare {
+    using policy_category = detail::comparison_policy;
+
+    template <class T>
+    static auto equal(const T& x, const T& y) noexcept -> bool {
+        if constexpr (detail::is_bitwise_range_v<T>) {
+            return equal(std::data(x), std::size(x), std::data(y), std::size(y));
+        } else {
+            static_assert(std::has_unique_object_representations_v<T>,
+                          "bitwise_compare requires a type with unique object representations");
+
+            return std::memcmp(&x, &y, sizeof(T)) == 0;
+        }
+    }
+
+    template <class T>
+    static auto less(const T& x, const T& y) -> bool {
+        if constexpr (detail::is_bitwise_range_v<T>) {
+            using element = std::remove_pointer_t<decltype(std::data(x))>;
+            return less(std::data(x), std::size(x), std::data(y), std::size(y),
+                        [](const element& a, const element& b) {
+                            if constexpr (detail::has_traits_type_v<T>) {
+                                return T::traits_type::lt(a, b);
+                            } else {
+                                return a < b;
+                            }
+                        });
+        } else {
+            return x < y;
+        }
+    }
+
+    template <class E>
+    static auto equal(const E* x, std::size_t n, const E* y, std::size_t m) noexcept -> bool {
+        static_assert(std::has_unique_object_representations_v<E>,
+                      "bitwise_compare requires a type with unique object representations");
+
+        return n == m && (n == 0 || std::memcmp(x, y, n * sizeof(E)) == 0);
+    }
+
+    template <class E, class Less = std::less<>>
+    static auto less(const E* x, std::size_t n, const E* y, std::size_t m, Less lt = Less())
+        -> bool {
+        static_assert(std::has_unique_object_representations_v<E>,
+                      "bitwise_compare requires a type with unique object representations");
+
+        const std::size_t k = std::min(n, m);
+        const std::size_t i = detail::bitwise_mismatch(x, y, k);
+        return i == k ? n < m : lt(x[i], y[i]);
+    }
+};
+
+template <class T, class... Policies>
+class weak_copy_on_write;
+
+template <class T, class... Policies>
+class atomic_copy_on_write;
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    Holds an allocator. An allocator whose instances always compare equal, such as
+    `std::allocator`, is not stored and a default constructed one is returned instead, so the
+    holder adds nothing to the size of a model and can be constant initialized.
+*/
+template <class A,
+          bool = std::allocator_traits<A>::is_always_equal::value &&
+                 std::is_default_constructible_v<A>>
+class allocator_holder {
+public:
+    constexpr allocator_holder() noexcept = default;
+    constexpr explicit allocator_holder(const A&) noexcept {}
+
+    auto allocator() const noexcept -> A { return A(); }
+};
+
+template <class A>
+class allocator_holder<A, false> {
+    A _alloc;
+
+public:
+    allocator_holder() noexcept : _alloc() {}
+    explicit allocator_holder(const A& a) noexcept : _alloc(a) {}
+
+    auto allocator() const noexcept -> const A& { return _alloc; }
+};
+
+/*
+    Tag to construct an immortal reference count.
+*/
+struct immortal_t {};
+
+/*
+    Storage for the value of a model. The value is constructed with the storage but destroyed
+    explicitly, so that with weak references it can be destroyed before the model is freed. If `T`
+    is trivially destructible so is the storage, and a model of `T` needs no destructor.
+*/
+template <class T, std::size_t Alignment, bool = std::is_trivially_destructible_v<T>>
+struct value_storage {
+    union {
+        alignas(Alignment) alignas(T) T _value;
+    };
+
+    template <class... Args>
+    constexpr explicit value_storage(std::in_place_t, Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<T, Args&&...>) :
+        _value(std::forward<Args>(args)...) {}
+
+    ~value_storage() {}
+};
+
+template <class T, std::size_t Alignment>
+struct value_storage<T, Alignment, true> {
+    union {
+        alignas(Alignment) alignas(T) T _value;
+    };
+
+    template <class... Args>
+    constexpr explicit value_storage(std::in_place_t, Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<T, Args&&...>) :
+        _value(std::forward<Args>(args)...) {}
+};
+
+/*
+    The hash of a model's value, if the hashing policy caches it. Concurrent readers may each
+    compute the hash, and all store the same value. A model is only written, and its hash
+    invalidated, when it is unique.
+
+    A unique value returned by write() may still be modified through the returned reference, so
+    after write() the hash is only stored again once the model is shared, as the value may not
+    be modified through that reference once another object refers to it.
+*/
+template <bool Cached>
+class hash_cache {
+public:
+    void invalidate_hash() noexcept {}
+    void invalidate_hash_until_shared() noexcept {}
+
+    template <class F>
+    auto cached_hash(F compute, bool) const -> std::size_t {
+        return compute();
+    }
+
+    [[nodiscard]] auto hash_differs(const hash_cache&) const noexcept -> bool { return false; }
+};
+
+template <>
+class hash_cache<true> {
+    enum state : unsigned char { invalid, valid, written };
+
+    mutable std::atomic<std::size_t> _hash{0};
+    mutable std::atomic<state> _state{invalid};
+
+    [[nodiscard]] auto is_valid() const noexcept -> bool {
+        return _state.load(std::memory_order_acquire) == valid;
+    }
+
+public:
+    void invalidate_hash() noexcept { _state.store(invalid, std::memory_order_relaxed); }
+
+    void invalidate_hash_until_shared() noexcept {
+        _state.store(written, std::memory_order_relaxed);
+    }
+
+    template <class F>
+    auto cached_hash(F compute, bool shared) const -> std::size_t {
+        const state current = _state.load(std::memory_order_acquire);
+        if (current == valid) return _hash.load(std::memory_order_relaxed);
+        const std::size_t result = compute();
+        if (current == invalid || shared) {
+            _hash.store(result, std::memory_order_relaxed);
+            _state.store(valid, std::memory_order_release);
+        }
+        return result;
+    }
+
+    [[nodiscard]] auto hash_differs(const hash_cache& x) const noexcept -> bool {
+        return is_valid() && x.is_valid() &&
+               _hash.load(std::memory_order_relaxed) != x._hash.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+    The function object a copy_on_write<T, Policies...> hashes its value with.
+*/
+template <class T, class... Policies>
+using hasher_t = std::conditional_t<
+    std::is_void_v<typename select_policy_t<hashing_policy, uncached_hash, Policies...>::hasher>,
+    std::hash<T>,
+    typename select_policy_t<hashing_policy, uncached_hash, Policies...>::hasher>;
+
+/*
+    The std::hash specialization for copy_on_write, disabled, as std::hash is for a type it does
+    not support, if the value cannot be hashed.
+*/
+template <class Cow, class T, class Hash, bool = std::is_invocable_r_v<std::size_t, Hash, const T&>>
+struct copy_on_write_hash {
+    copy_on_write_hash() = delete;
+    copy_on_write_hash(const copy_on_write_hash&) = delete;
+    auto operator=(const copy_on_write_hash&) -> copy_on_write_hash& = delete;
+};
+
+template <class Cow, class T, class Hash>
+struct copy_on_write_hash<Cow, T, Hash, true> {
+    auto operator()(const Cow& x) const -> std::size_t { return x.hash(); }
+};
+
+/*
+    The reference count of a model. The count starts at one. decrement(n) releases `n`
+    references and returns true when the last reference is released.
+
+    An immortal count is never modified, so any number of threads can share the model without
+    contending for its cache line. It is never unique and is never released.
+*/
+template <class Threading>
+class reference_count;
+
+template <>
+class reference_count<multi_threaded> {
+    static constexpr std::size_t immortal = std::numeric_limits<std::size_t>::max();
+
+    std::atomic<std::size_t> _count{1};
+
+public:
+    constexpr reference_count() noexcept = default;
+    constexpr explicit reference_count(immortal_t) noexcept : _count{immortal} {}
+
+    void increment() noexcept {
+        if (_count.load(std::memory_order_relaxed) == immortal) return;
+        // coverity[useless_call]
+        _count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+        The release and acquire are needed even if the value is trivially destructible: they
+        order every other thread's reads of the value before the model is deallocated, and the
+        memory possibly reused by the allocator.
+    */
+    auto decrement(std::size_t n = 1) noexcept -> bool {
+        if (_count.load(std::memory_order_relaxed) == immortal) return false;
+#if STLAB_COPY_ON_WRITE_TSAN
+        return _count.fetch_sub(n, std::memory_order_acq_rel) == n;
+#else
+        if (_count.fetch_sub(n, std::memory_order_release) != n) return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+#endif
+    }
+
+    /*
+        Increments the count unless it is zero. Returns false if it was zero.
+    */
+    auto increment_if_nonzero() noexcept -> bool {
+        std::size_t n = _count.load(std::memory_order_relaxed);
+        do {
+            if (n == 0) return false;
+            if (n == immortal) return true;
+        } while (!_count.compare_exchange_weak(n, n + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+        return true;
+    }
+
+    /*
+        Releases the last reference, leaving the count zero, if the count is one. Returns false,
+        leaving the count unchanged, otherwise.
+    */
+    auto release_if_unique() noexcept -> bool {
+        std::size_t n = 1;
+        return _count.compare_exchange_strong(n, 0, std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto unique() const noexcept -> bool {
+        return _count.load(std::memory_order_acquire) == 1;
+    }
+
+    [[nodiscard]] auto use_count() const noexcept -> std::size_t {
+        return _count.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] auto load() const noexcept -> std::size_t {
+        return _count.load(std::memory_order_relaxed);
+    }
+};
+
+template <>
+class reference_count<single_threaded> {
+    static constexpr std::size_t immortal = std::numeric_limits<std::size_t>::max();
+
+    std::size_t _count{1};
+
+public:
+    constexpr reference_count() noexcept = default;
+    constexpr explicit reference_count(immortal_t) noexcept : _count{immortal} {}
+
+    void increment() noexcept {
+        if (_count != immortal) ++_count;
+    }
+
+    auto decrement(std::size_t n = 1) noexcept -> bool {
+        return _count != immortal && (_count -= n) == 0;
+    }
+
+    auto increment_if_nonzero() noexcept -> bool {
+        if (_count == 0) return false;
+        increment();
+        return true;
+    }
+
+    auto release_if_unique() noexcept -> bool {
+        if (_count != 1) return false;
+        _count = 0;
+        return true;
+    }
+
+    [[nodiscard]] auto unique() const noexcept -> bool { return _count == 1; }
+
+    [[nodiscard]] auto use_count() const noexcept -> std::size_t { return _count; }
+
+    [[nodiscard]] auto load() const noexcept -> std::size_t { return _count; }
+};
+
+/*
+    The count of weak references to a model, if the weak reference policy is enabled. The count
+    starts at one, a reference held on behalf of all the strong references and released with the
+    last of them, so the model is freed by whichever of the last strong or weak reference is
+    released last.
+*/
+template <bool Enabled, class Count>
+class weak_count {
+public:
+    constexpr weak_count() noexcept = default;
+    constexpr explicit weak_count(immortal_t) noexcept {}
+
+    static constexpr auto decrement_weak() noexcept -> bool { return true; }
+    static constexpr auto weak_referenced() noexcept -> bool { return false; }
+};
+
+template <class Count>
+class weak_count<true, Count> {
+    Count _weak;
+
+public:
+    constexpr weak_count() noexcept = default;
+    constexpr explicit weak_count(immortal_t) noexcept : _weak(immortal_t{}) {}
+
+    void increment_weak() noexcept { _weak.increment(); }
+    auto decrement_weak() noexcept -> bool { return _weak.decrement(); }
+
+    /*
+        Returns true if any weak reference refers to the model. A new weak reference is only made
+        from an existing reference, so if the model is unique and this returns false no other
+        thread can make one.
+    */
+    [[nodiscard]] auto weak_referenced() const noexcept -> bool { return _weak.use_count() != 1; }
+};
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    A copy-on-write wrapper for any type that models Regular.
+
+    Copy-on-write semantics allow for an object to be lazily copied - only creating a copy when
+    the value is modified and there is more than one reference to the value.
+
+    The behavior can be customized with `Policies`, given in any order:
+
+    - An allocator, defaulting to `std::allocator<T>`. The underlying value is stored, together
+      with its reference count, in a single block allocated with the allocator. The allocator is
+      stored in the block, so copies made by write() are allocated from the same allocator as the
+      value they were copied from.
+    - A threading policy, either stlab::multi_threaded (the default) or stlab::single_threaded.
+    - A layout policy, stlab::padded_count, to place the reference count and value on separate
+      cache lines. By default they are adjacent.
+    - An instrumentation policy, stlab::instrumented, to observe sharing, copying and in-place
+      mutation. By default there is no instrumentation.
+    - A hashing policy, stlab::cached_hash, to store the hash of the value in the model.
+    - A weak reference policy, stlab::weak_references, to support stlab::weak_copy_on_write.
+    - A recycling policy, stlab::recycled_models, to reuse released models, and the storage owned
+      by their values, on each thread.
+    - A comparison policy, stlab::bitwise_compare, to compare values by their bytes. By default
+      values are compared with their own operators.
+
+    Over-aligned types are supported provided the allocator honors the alignment of the block, as
+    `std::allocator` does.
+
+    With the default policies this class is thread safe and supports types that model Moveable.
+*/
+template <typename T, typename... Policies> // T models Regular
+class copy_on_write {
+    static_assert(detail::count_policy_v<detail::allocator_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one allocator");
+    static_assert(detail::count_policy_v<detail::threading_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one threading policy");
+    static_assert(detail::count_policy_v<detail::layout_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one layout policy");
+    static_assert(detail::count_policy_v<detail::instrumentation_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one instrumentation policy");
+    static_assert(detail::count_policy_v<detail::hashing_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one hashing policy");
+    static_assert(detail::count_policy_v<detail::weak_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one weak reference policy");
+    static_assert(detail::count_policy_v<detail::recycling_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one recycling policy");
+    static_assert(detail::count_policy_v<detail::comparison_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one comparison policy");
+
+    using Alloc = detail::select_policy_t<detail::allocator_policy, std::allocator<T>, Policies...>;
+    using threading =
+        detail::select_policy_t<detail::threading_policy, multi_threaded, Policies...>;
+    using layout =
+        detail::select_policy_t<detail::layout_policy, detail::compact_layout, Policies...>;
+    using observer = typename detail::select_policy_t<detail::instrumentation_policy,
+                                                      instrumented<copy_on_write_observer>,
+                                                      Policies...>::observer;
+    using hashing =
+        detail::select_policy_t<detail::hashing_policy, detail::uncached_hash, Policies...>;
+    using hasher = detail::hasher_t<T, Policies...>;
+    using weak =
+        detail::select_policy_t<detail::weak_policy, detail::no_weak_references, Policies...>;
+    using recycling =
+        detail::select_policy_t<detail::recycling_policy, detail::no_recycling, Policies...>;
+    using comparison =
+        detail::select_policy_t<detail::comparison_policy, detail::value_compare, Policies...>;
+    using count_type = detail::reference_count<threading>;
+
+    struct model;
+
+    using model_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<model>;
+    using model_traits = std::allocator_traits<model_allocator>;
+
+    /*
+        The value is destroyed by delete_model(), which with weak references is before the model
+        is freed, or by the holder of the default model.
+    */
+    struct model : detail::allocator_holder<model_allocator>,
+                   detail::hash_cache<hashing::cached>,
+                   detail::weak_count<weak::enabled, count_type>,
+                   detail::value_storage<T, layout::alignment> {
+        alignas(layout::alignment) alignas(count_type) count_type _count;
+
+        template <class... Args>
+        explicit model(const model_allocator& a, Args&&... args) noexcept(
+            std::is_nothrow_constructible_v<T, Args&&...>) :
+            detail::allocator_holder<model_allocator>(a),
+            detail::value_storage<T, layout::alignment>(std::in_place,
+                                                        std::forward<Args>(args)...) {}
+
+        constexpr explicit model(detail::immortal_t) noexcept(std::is_nothrow_constructible_v<T>) :
+            detail::weak_count<weak::enabled, count_type>(detail::immortal_t{}),
+            detail::value_storage<T, layout::alignment>(std::in_place),
+            _count(detail::immortal_t{}) {}
+    };
+
+    static_assert(recycling::capacity == 0 || !weak::enabled,
+                  "stlab::recycled_models does not support weak references");
+    static_assert(recycling::capacity == 0 ||
+                      (std::allocator_traits<model_allocator>::is_always_equal::value &&
+                       std::is_default_constructible_v<model_allocator>),
+                  "stlab::recycled_models requires an allocator whose instances compare equal");
+
+    /*
+        The models released on this thread, with their values constructed, for the recycling
+        policy. The pool is trivially destructible so it can still be checked by a copy_on_write
+        destroyed after the thread's thread_local objects, such as one with static storage
+        duration on the main thread.
+    */
+    struct model_pool {
+        model* _models[recycling::capacity];
+        std::size_t _size;
+        bool _alive;
+    };
+
+    /*
+        Destroys the values and frees the models in this thread's pool when the thread exits,
+        and marks the pool as no longer alive so later releases destroy their models directly.
+    */
+    struct model_pool_drain {
+        model_pool& _pool;
+
+        explicit model_pool_drain(model_pool& pool) noexcept : _pool(pool) { _pool._alive = true; }
+
+        ~model_pool_drain() {
+            _pool._alive = false;
+            while (_pool._size) destroy_model(_pool._models[--_pool._size]);
+        }
+    };
+
+    /*
+        Returns this thread's pool, or nullptr once the thread's thread_local objects have been
+        destroyed.
+    */
+    static auto pool() noexcept -> model_pool* {
+        thread_local model_pool pool_s{};
+        thread_local model_pool_drain drain_s(pool_s);
+        return pool_s._alive ? &pool_s : nullptr;
+    }
+
+    model* _self;
+
+    template <class U>
+    using disable_copy = std::enable_if_t<!std::is_same_v<std::decay_t<U>, copy_on_write>>*;
+
+    template <typename U>
+    using disable_copy_assign =
+        std::enable_if_t<!std::is_same_v<std::decay_t<U>, copy_on_write>, copy_on_write&>;
+
+    template <class U>
+    using disable_allocator_arg =
+        std::enable_if_t<!std::is_same_v<std::decay_t<U>, std::allocator_arg_t>>*;
+
+    /*
+        The model shared by all default constructed instances. Its count is immortal so copying
+        and destroying default constructed instances never writes to it.
+
+        If `T` is trivially destructible and its default constructor is constexpr, the model is
+        constant initialized and default construction does not check an initialization guard.
+    */
+    auto default_model() noexcept(std::is_nothrow_constructible_v<T>) -> model* {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            static model default_s{detail::immortal_t{}};
+            return &default_s;
+        } else {
+            struct holder {
+                model _model{detail::immortal_t{}};
+                ~holder() { std::destroy_at(&_model._value); }
+            };
+            static holder default_s;
+            return &default_s._model;
+        }
+    }
+
+    template <class... Args>
+    static auto new_model(const model_allocator& a, Args&&... args) -> model* {
+        static_assert(std::is_same_v<typename model_traits::pointer, model*>,
+                      "copy_on_write requires an allocator with raw pointers");
+
+        model_allocator alloc{a};
+        model* p = model_traits::allocate(alloc, 1);
+        assert((reinterpret_cast<std::uintptr_t>(p) % alignof(model) == 0) &&
+               "FATAL (sparent) : allocator returned misaligned storage");
+        try {
+            model_traits::construct(alloc, p, a, std::forward<Args>(args)...);
+        } catch (...) {
+            model_traits::deallocate(alloc, p, 1);
+            throw;
+        }
+        return p;
+    }
+
+    /*
+        Returns a model holding a value assigned from `x`, recycled from this thread's pool if the
+        policy is enabled and the pool is not empty, otherwise newly allocated with `a`. If the
+        assignment throws the model is returned to the pool.
+    */
+    template <class U>
+    static auto acquire_model(const model_allocator& a, U&& x) -> model* {
+        if constexpr (recycling::capacity != 0) {
+            model_pool* pool = copy_on_write::pool();
+            if (pool && pool->_size) {
+                model* p = pool->_models[--pool->_size];
+                try {
+                    p->_value = std::forward<U>(x);
+                } catch (...) {
+                    pool->_models[pool->_size++] = p;
+                    throw;
+                }
+                p->invalidate_hash();
+                p->_count.increment();
+                return p;
+            }
+        }
+        return new_model(a, std::forward<U>(x));
+    }
+
+    /*
+        GCC cannot see that the immortal default model is never released and warns when a default
+        constructed instance is destroyed.
+    */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+#endif
+    static void delete_model(model* p) noexcept {
+        if constexpr (recycling::capacity != 0) {
+            model_pool* pool = copy_on_write::pool();
+            if (pool && pool->_size != recycling::capacity) {
+                pool->_models[pool->_size++] = p;
+                return;
+            }
+        }
+        destroy_model(p);
+    }
+
+    static void destroy_model(model* p) noexcept {
+        std::destroy_at(&p->_value);
+        if (p->decrement_weak()) free_model(p);
+    }
+
+    static void free_model(model* p) noexcept {
+        model_allocator alloc{p->allocator()};
+        model_traits::destroy(alloc, p);
+        model_traits::deallocate(alloc, p, 1);
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    /*
+        The allocator for a model replacing the current one. A moved-from object has no allocator
+        and falls back to a default constructed one.
+    */
+    auto replacement_allocator() const noexcept -> Alloc {
+        if constexpr (std::is_default_constructible_v<Alloc>) {
+            if (!_self) return Alloc();
+        }
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return Alloc(_self->allocator());
+    }
+
+    struct adopt_t {};
+    static constexpr adopt_t adopt{};
+
+    /*
+        Takes ownership of a newly allocated model.
+    */
+    copy_on_write(adopt_t, model* p) noexcept : _self(p) {}
+
+    /*
+        Returns true if the value may be written in place: this is the only reference to it and
+        no weak reference can observe the write. If weak references refer to the value, the
+        model is expired and the value moved to a new model, so a weak reference never sees a
+        value change and a model identifies a single value. Returns false if the value is shared,
+        or a weak reference locked it before it could be expired.
+    */
+    auto writable() -> bool {
+        if (!unique()) return false;
+        if constexpr (weak::enabled) {
+            if (_self->weak_referenced()) return expire();
+        }
+        return true;
+    }
+
+    auto expire() -> bool {
+        if (!_self->_count.release_if_unique()) return false;
+
+        model* p;
+        try {
+            p = new_model(_self->allocator(), std::move(_self->_value));
+        } catch (...) {
+            _self->_count.increment();
+            throw;
+        }
+        destroy_model(std::exchange(_self, p));
+        return true;
+    }
+
+    template <class I, class F>
+    friend void write_all(I first, I last, F f);
+
+    friend class weak_copy_on_write<T, Policies...>;
+    friend class atomic_copy_on_write<T, Policies...>;
+
+public:
+    /*!
+        @deprecated Use element_type instead. The type of value stored.
+    */
+    /* [[deprecated]] */ using value_type = T;
+
+    /*!
+        The type of value stored.
+    */
+    using element_type = T;
+
+    /*!
+        The type of allocator used to allocate the underlying value.
+    */
+    using allocator_type = Alloc;
+
+    /*!
+        The type of a weak reference to the underlying value, with the stlab::weak_references
+        policy.
+    */
+    using weak_type = weak_copy_on_write<T, Policies...>;
+
+    /*!
+        Default constructs the wrapped value.
+
+        All default constructed instances share a single value and are not unique. Default
+        construction, and copying or destroying a default constructed instance, does not modify
+        any shared state.
+    */
+    copy_on_write() noexcept(std::is_nothrow_constructible_v<T>) : _self(default_model()) {}
+
+    /*!
+        Constructs a new instance by forwarding arguments to the wrapped value constructor.
+    */
+    template <class U>
+    copy_on_write(U&& x, disable_copy<U> = nullptr) :
+        _self(new_model(model_allocator(), std::forward<U>(x))) {
+        observer::on_construct(observer::size(_self->_value));
+    }
+
+    /*!
+        Constructs a new instance by forwarding multiple arguments to the wrapped value constructor.
+    */
+    template <class U, class V, class... Args, disable_allocator_arg<U> = nullptr>
+    copy_on_write(U&& x, V&& y, Args&&... args) :
+        _self(new_model(model_allocator(),
+                        std::forward<U>(x),
+                        std::forward<V>(y),
+                        std::forward<Args>(args)...)) {
+        observer::on_construct(observer::size(_self->_value));
+    }
+
+    /*!
+        Constructs a new instance, allocated with `a`, by forwarding arguments to the wrapped value
+        constructor. With no arguments the wrapped value is value initialized.
+    */
+    template <class... Args>
+    copy_on_write(std::allocator_arg_t, const allocator_type& a, Args&&... args) :
+        _self(new_model(model_allocator(a), std::forward<Args>(args)...)) {
+        observer::on_construct(observer::size(_self->_value));
+    }
+
+    /*!
+        Copy constructor that shares the underlying data with the source object.
+    */
+    copy_on_write(const copy_on_write& x) noexcept : _self(x._self) {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        _self->_count.increment();
+        observer::on_share();
+    }
+
+    /*!
+        Move constructor that takes ownership of the source object's data.
+    */
+    copy_on_write(copy_on_write&& x) noexcept : _self{std::exchange(x._self, nullptr)} {
+        assert(_self && "WARNING (sparent) : using a moved copy_on_write object");
+    }
+
+    ~copy_on_write() {
+        assert(!_self || ((_self->_count.load() > 0) && "FATAL (sparent) : double delete"));
+        if (_self && _self->_count.decrement()) {
+            observer::on_destroy(observer::size(_self->_value));
+            delete_model(_self);
+        }
+    }
+
+    /*!
+        Copy assignment operator that shares the underlying data with the source object.
+    */
+    auto operator=(const copy_on_write& x) noexcept -> copy_on_write& {
+        // self-assignment is not allowed to disable cert-oop54-cpp warning (and is likely a bug)
+        assert(this != &x && "self-assignment is not allowed");
+        return *this = copy_on_write(x);
+    }
+
+    /*!
+        Move assignment operator that takes ownership of the source object's data.
+    */
+    auto operator=(copy_on_write&& x) noexcept -> copy_on_write& {
+        auto tmp{std::move(x)};
+        swap(*this, tmp);
+        return *this;
+    }
+
+    /*!
+        Assigns a new value to the wrapped object, optimizing for in-place assignment when unique.
+    */
+    template <class U>
+    auto operator=(U&& x) -> disable_copy_assign<U> {
+        if (_self && writable()) {
+            _self->_value = std::forward<U>(x);
+            _self->invalidate_hash();
+            observer::on_assign_inplace();
+            return *this;
+        }
+
+        if constexpr (recycling::capacity != 0) {
+            *this = copy_on_write(adopt, acquire_model(model_allocator(), std::forward<U>(x)));
+            observer::on_construct(observer::size(_self->_value));
+            return *this;
+        } else {
+            return *this = copy_on_write(std::allocator_arg, replacement_allocator(),
+                                         std::forward<U>(x));
+        }
+    }
+
+    /*!
+        Obtains a non-const reference to the underlying value.
+
+        This will copy the underlying value if necessary so changes to the value do not affect
+        other copy_on_write objects sharing the same data.
+    */
+    auto write() -> element_type& {
+        if (!writable()) {
+            *this = copy_on_write(adopt, acquire_model(_self->allocator(), read()));
+            observer::on_detach(observer::size(_self->_value));
+        } else {
+            observer::on_write_inplace();
+        }
+
+        _self->invalidate_hash_until_shared();
+        return _self->_value;
+    }
+
+    /*!
+        If the object is not unique, the transform is applied to the underlying value to copy it and
+        a reference to the new value is returned. If the object is unique, the inplace function is
+        called with a reference to the underlying value and a reference to the value is returned.
+
+        @param transform A function object that takes a const reference to the underlying value and
+        returns a new value.
+        @param inplace A function object that takes a reference to the underlying value and modifies
+        it in place.
+
+        @return A reference to the underlying value.
+    */
+    template <class Transform, class Inplace>
+    auto write(Transform transform, Inplace inplace) -> element_type& {
+        static_assert(std::is_invocable_r_v<T, Transform, const T&>,
+                      "Transform must be invocable with const T&");
+        static_assert(std::is_invocable_r_v<void, Inplace, T&>,
+                      "Inplace must be invocable with T&");
+
+        if (!writable()) {
+            *this = copy_on_write(adopt, acquire_model(_self->allocator(), transform(read())));
+            observer::on_detach(observer::size(_self->_value));
+        } else {
+            inplace(_self->_value);
+            observer::on_write_inplace();
+        }
+
+        _self->invalidate_hash_until_shared();
+        return _self->_value;
+    }
+
+    /*!
+        Calls `f` with a non-const reference to the underlying value if the object is unique.
+        Otherwise `f` is not called and the value is neither copied nor allocated.
+
+        Deciding between the two takes a single load of the reference count. With weak
+        references, a unique value that weak references refer to is first moved to a new model,
+        as by write().
+
+        @param f A function object that takes a reference to the underlying value and modifies it
+        in place.
+
+        @return True if `f` was called.
+    */
+    template <class F>
+    auto try_write(F f) -> bool {
+        static_assert(std::is_invocable_v<F, T&>, "F must be invocable with T&");
+
+        if (!writable()) return false;
+
+        _self->invalidate_hash();
+        observer::on_write_inplace();
+        f(_self->_value);
+        return true;
+    }
+
+    /*!
+        Calls `f` with a reference obtained from write(), copying the value only if it is shared,
+        if `pred` returns true for the underlying value. Otherwise the value is not written, so a
+        shared value is not copied when there is nothing to change.
+
+        @param pred A function object that takes a const reference to the underlying value and
+        returns true if it should be written.
+        @param f A function object that takes a reference to the underlying value and modifies it.
+
+        @return True if `f` was called.
+    */
+    template <class Predicate, class F>
+    auto write_if(Predicate pred, F f) -> bool {
+        static_assert(std::is_invocable_r_v<bool, Predicate, const T&>,
+                      "Predicate must be invocable with const T&");
+        static_assert(std::is_invocable_v<F, T&>, "F must be invocable with T&");
+
+        if (!pred(read())) return false;
+
+        f(write());
+        return true;
+    }
+
+    class prepared_write;
+
+    /*!
+        Starts copying the underlying value, if it is shared, by passing a nullary task to
+        `executor`. The copy is installed by a later call to write(prepared_write&&), so the cost
+        of detaching is paid ahead of the write, off the caller's thread.
+
+        If the object is unique, no copy is started.
+
+        @param executor A function object invocable with a `void()` task.
+    */
+    template <class Executor>
+    [[nodiscard]] auto prepare_write(Executor executor) -> prepared_write {
+        static_assert(std::is_same_v<threading, multi_threaded>,
+                      "prepare_write requires the multi_threaded policy");
+
+        if (unique()) return prepared_write();
+
+        auto promise = std::make_shared<std::promise<copy_on_write>>();
+        prepared_write result(*this, promise->get_future());
+        executor([promise, snapshot = *this]() mutable noexcept {
+            try {
+                copy_on_write copy(adopt, new_model(snapshot._self->allocator(), snapshot.read()));
+                observer::on_detach(observer::size(copy.read()));
+                // Release the snapshot so the value can be written in place if it is all
+                // that kept the object from being unique.
+                { auto release = std::move(snapshot); }
+                promise->set_value(std::move(copy));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return result;
+    }
+
+    /*!
+        Obtains a non-const reference to the underlying value, as write(), using the copy started
+        by prepare_write() if the object still refers to the value that was copied.
+
+        This waits for the copy to complete. If the object became unique in the meantime, the copy
+        is discarded and the value is written in place. If the object was assigned or written
+        since prepare_write(), this is equivalent to write(). If the copy threw, the exception is
+        rethrown and the object is unchanged.
+    */
+    auto write(prepared_write&& prepared) -> element_type& {
+        if (!prepared._copy.valid() || prepared._source._self != _self) return write();
+
+        copy_on_write copy = prepared._copy.get();
+        { auto release = std::move(prepared._source); }
+        if (writable()) {
+            observer::on_write_inplace();
+        } else {
+            *this = std::move(copy);
+        }
+
+        _self->invalidate_hash_until_shared();
+        return _self->_value;
+    }
+
+    /*!
+        Takes the underlying value out of the object. If the object is unique the value is moved
+        out, otherwise it is copied, and the object's reference is released. The object is left
+        in the moved-from state.
+
+        If the copy throws, the object is unchanged.
+    */
+    [[nodiscard]] auto extract() && -> element_type {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        if (writable()) {
+            const std::size_t bytes = observer::size(_self->_value);
+            element_type result(std::move(_self->_value));
+            delete_model(std::exchange(_self, nullptr));
+            observer::on_destroy(bytes);
+            return result;
+        }
+
+        element_type result(read());
+        observer::on_detach(observer::size(result));
+        { auto release = std::move(*this); }
+        return result;
+    }
+
+    /*!
+        Returns a const reference to the underlying value for read-only access.
+    */
+    [[nodiscard]] auto read() const noexcept -> const element_type& {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->_value;
+    }
+
+    /*!
+        Implicit conversion to const reference of the underlying value.
+    */
+    operator const element_type&() const noexcept { return read(); }
+
+    /*!
+        Dereference operator that returns a const reference to the underlying value.
+    */
+    auto operator*() const noexcept -> const element_type& { return read(); }
+
+    /*!
+        Arrow operator that returns a const pointer to the underlying value.
+    */
+    auto operator->() const noexcept -> const element_type* { return &read(); }
+
+    /*!
+        Returns true if this is the only reference to the underlying object.
+
+        This is useful to determine if calling write() will cause a copy.
+    */
+    [[nodiscard]] auto unique() const noexcept -> bool {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->_count.unique();
+    }
+
+    /*!
+        @deprecated Use unique() instead. Returns true if this is the only reference to the
+       underlying object.
+    */
+    [[deprecated]] [[nodiscard]] auto unique_instance() const noexcept -> bool { return unique(); }
+
+    /*!
+        Returns the number of copy_on_write objects sharing the underlying value. In a
+        multi-threaded program the count may change as soon as it is returned, so it is suitable
+        for diagnostics and memory accounting, not synchronization.
+
+        The value of default constructed objects is shared by all of them and never released, and
+        its count is `std::numeric_limits<std::size_t>::max()`.
+    */
+    [[nodiscard]] auto use_count() const noexcept -> std::size_t {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->_count.use_count();
+    }
+
+    /*!
+        Returns true if this object and the given object share the same underlying data.
+    */
+    [[nodiscard]] auto identity(const copy_on_write& x) const noexcept -> bool {
+        assert((_self && x._self) && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self == x._self;
+    }
+
+    /*!
+        Returns the hash of the underlying value. With the stlab::cached_hash policy the hash is
+        computed once and reused until the value is written, otherwise it is computed with
+        `std::hash<T>` on each call.
+
+        After write() on a unique object the value may still be modified through the returned
+        reference, so the hash is computed on each call until the value is shared.
+    */
+    [[nodiscard]] auto hash() const -> std::size_t {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->cached_hash([&] { return hasher()(_self->_value); }, !unique());
+    }
+
+    /*!
+        Orders objects by the value they refer to rather than by the value itself, consistent with
+        identity(). Together with owner_hash() and owner_equal() these allow copy_on_write and
+        weak_copy_on_write objects to be used as keys in containers, see stlab::owner_less.
+
+        With the stlab::weak_references policy a model holds a single value while any weak
+        reference refers to it, as writing the value moves it to a new model, so a result cached
+        with a weak key is never found for a written value.
+    */
+    [[nodiscard]] auto owner_before(const copy_on_write& x) const noexcept -> bool {
+        return std::less<const model*>()(_self, x._self);
+    }
+
+    template <class W, std::enable_if_t<std::is_same_v<W, weak_type>>* = nullptr>
+    [[nodiscard]] auto owner_before(const W& x) const noexcept -> bool {
+        return std::less<const model*>()(_self, x._self);
+    }
+
+    /*!
+        Returns a hash of the value this object refers to, consistent with owner_equal().
+    */
+    [[nodiscard]] auto owner_hash() const noexcept -> std::size_t {
+        return std::hash<const model*>()(_self);
+    }
+
+    /*!
+        Returns true if this object and `x` refer to the same value, see identity().
+    */
+    [[nodiscard]] auto owner_equal(const copy_on_write& x) const noexcept -> bool {
+        return _self == x._self;
+    }
+
+    template <class W, std::enable_if_t<std::is_same_v<W, weak_type>>* = nullptr>
+    [[nodiscard]] auto owner_equal(const W& x) const noexcept -> bool {
+        return _self == x._self;
+    }
+
+    /*!
+        Returns a copy of the allocator used to allocate the underlying value.
+    */
+    [[nodiscard]] auto get_allocator() const noexcept -> allocator_type {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return allocator_type(_self->allocator());
+    }
+
+    /*!
+        Efficiently swaps the contents of two copy_on_write objects.
+    */
+    friend inline void swap(copy_on_write& x, copy_on_write& y) noexcept {
+        std::swap(x._self, y._self);
+    }
+
+    /*! @{ */
+    /*!
+        Comparisons can be done with the underlying value or the copy_on_write object.
+    */
+    friend inline auto operator<(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !x.identity(y) && comparison::less(*x, *y);
+    }
+
+    friend inline auto operator<(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return comparison::less(*x, y);
+    }
+
+    friend inline auto operator<(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return comparison::less(x, *y);
+    }
+
+    friend inline auto operator>(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator>(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator>(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator<=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator<=(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator<=(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator>=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator>=(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator>=(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator==(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return x.identity(y) ||
+               (!x._self->hash_differs(*y._self) && comparison::equal(*x, *y));
+    }
+
+    friend inline auto operator==(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return comparison::equal(*x, y);
+    }
+
+    friend inline auto operator==(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return comparison::equal(x, *y);
+    }
+
+    friend inline auto operator!=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !(x == y);
+    }
+
+    friend inline auto operator!=(const copy_on_write& x, const element_type& y) noexcept -> bool {
+        return !(x == y);
+    }
+
+    friend inline auto operator!=(const element_type& x, const copy_on_write& y) noexcept -> bool {
+        return !(x == y);
+    }
+    /*! @} */
+};
+
+/*!
+    A copy of a copy_on_write value in progress, returned by copy_on_write::prepare_write().
+    Destroying a prepared_write abandons the copy.
+*/
+template <class T, class... Policies>
+class copy_on_write<T, Policies...>::prepared_write {
+    friend class copy_on_write;
+
+    copy_on_write _source;
+    std::future<copy_on_write> _copy;
+
+    prepared_write() noexcept : _source(adopt, static_cast<model*>(nullptr)) {}
+    prepared_write(const copy_on_write& source, std::future<copy_on_write> copy) noexcept :
+        _source(source), _copy(std::move(copy)) {}
+
+public:
+    prepared_write(prepared_write&& x) noexcept :
+        _source(adopt, std::exchange(x._source._self, nullptr)), _copy(std::move(x._copy)) {}
+
+    auto operator=(prepared_write&& x) noexcept -> prepared_write& {
+        copy_on_write(adopt, std::exchange(_source._self, std::exchange(x._source._self, nullptr)));
+        _copy = std::move(x._copy);
+        return *this;
+    }
+};
+
+/**************************************************************************************************/
+
+/*!
+    A weak reference to the value of a copy_on_write with the stlab::weak_references policy.
+
+    A weak reference does not keep the value alive and does not count toward unique(). lock()
+    returns a copy_on_write sharing the value if any copy_on_write still refers to it. Writing
+    the value through the copy_on_write that holds it moves it to a new model and expires the
+    weak reference, so a locked value is always the value the reference was made from.
+*/
+template <class T, class... Policies>
+class weak_copy_on_write {
+    using strong_type = copy_on_write<T, Policies...>;
+    using model = typename strong_type::model;
+    using observer = typename strong_type::observer;
+
+    static_assert(strong_type::weak::enabled,
+                  "weak_copy_on_write requires the stlab::weak_references policy");
+
+    model* _self{nullptr};
+
+    friend strong_type;
+
+public:
+    /*!
+        Constructs a weak reference that refers to no value and is expired.
+    */
+    weak_copy_on_write() noexcept = default;
+
+    /*!
+        Constructs a weak reference to the value of `x`.
+    */
+    weak_copy_on_write(const strong_type& x) noexcept : _self(x._self) {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        _self->increment_weak();
+    }
+
+    weak_copy_on_write(const weak_copy_on_write& x) noexcept : _self(x._self) {
+        if (_self) _self->increment_weak();
+    }
+
+    weak_copy_on_write(weak_copy_on_write&& x) noexcept : _self(std::exchange(x._self, nullptr)) {}
+
+    ~weak_copy_on_write() {
+        if (_self && _self->decrement_weak()) strong_type::free_model(_self);
+    }
+
+    auto operator=(const weak_copy_on_write& x) noexcept -> weak_copy_on_write& {
+        return *this = weak_copy_on_write(x);
+    }
+
+    auto operator=(weak_copy_on_write&& x) noexcept -> weak_copy_on_write& {
+        auto tmp{std::move(x)};
+        std::swap(_self, tmp._self);
+        return *this;
+    }
+
+    /*!
+        Returns true if no copy_on_write refers to the value, so lock() would fail.
+    */
+    [[nodiscard]] auto expired() const noexcept -> bool {
+        return !_self || _self->_count.use_count() == 0;
+    }
+
+    /*!
+        Returns a copy_on_write sharing the value, or an empty optional if the reference has
+        expired.
+    */
+    [[nodiscard]] auto lock() const noexcept -> std::optional<strong_type> {
+        if (!_self || !_self->_count.increment_if_nonzero()) return std::nullopt;
+        observer::on_share();
+        return strong_type(strong_type::adopt, _self);
+    }
+
+    /*!
+        Returns the number of copy_on_write objects referring to the value, zero if the reference
+        has expired.
+    */
+    [[nodiscard]] auto use_count() const noexcept -> std::size_t {
+        return _self ? _self->_count.use_count() : 0;
+    }
+
+    /*!
+        Releases the reference, leaving this object expired.
+    */
+    void reset() noexcept { weak_copy_on_write().swap(*this); }
+
+    void swap(weak_copy_on_write& x) noexcept { std::swap(_self, x._self); }
+
+    friend void swap(weak_copy_on_write& x, weak_copy_on_write& y) noexcept { x.swap(y); }
+
+    /*!
+        Orders references by the value they refer to, which is unaffected by the reference
+        expiring, see copy_on_write::owner_before().
+    */
+    [[nodiscard]] auto owner_before(const weak_copy_on_write& x) const noexcept -> bool {
+        return std::less<const model*>()(_self, x._self);
+    }
+
+    [[nodiscard]] auto owner_before(const strong_type& x) const noexcept -> bool {
+        return std::less<const model*>()(_self, x._self);
+    }
+
+    /*!
+        Returns a hash of the value this object refers to, consistent with owner_equal().
+    */
+    [[nodiscard]] auto owner_hash() const noexcept -> std::size_t {
+        return std::hash<const model*>()(_self);
+    }
+
+    /*!
+        Returns true if this object and `x` refer to the same value.
+    */
+    [[nodiscard]] auto owner_equal(const weak_copy_on_write& x) const noexcept -> bool {
+        return _self == x._self;
+    }
+
+    [[nodiscard]] auto owner_equal(const strong_type& x) const noexcept -> bool {
+        return _self == x._self;
+    }
+};
+
+/*!
+    Orders copy_on_write and weak_copy_on_write objects, in any combination, by the value they
+    refer to with owner_before(). A weak reference keeps its position after it expires, so the
+    function object can order the keys of a cache of results computed from copy_on_write values.
+*/
+struct owner_less {
+    using is_transparent = void;
+
+    template <class X, class Y>
+    auto operator()(const X& x, const Y& y) const noexcept -> bool {
+        return x.owner_before(y);
+    }
+};
+
+/*!
+    Hashes copy_on_write and weak_copy_on_write objects by the value they refer to with
+    owner_hash().
+*/
+struct owner_hash {
+    using is_transparent = void;
+
+    template <class X>
+    auto operator()(const X& x) const noexcept -> std::size_t {
+        return x.owner_hash();
+    }
+};
+
+/*!
+    Compares copy_on_write and weak_copy_on_write objects, in any combination, by the value they
+    refer to with owner_equal().
+*/
+struct owner_equal {
+    using is_transparent = void;
+
+    template <class X, class Y>
+    auto operator()(const X& x, const Y& y) const noexcept -> bool {
+        return x.owner_equal(y);
+    }
+};
+
+/*!
+    Constructs a copy_on_write whose underlying value is allocated with `alloc`, forwarding `args`
+    to the constructor of `T`. This is the copy_on_write analog of `std::allocate_shared()`.
+    Additional `Policies` for the result may be given explicitly after `T`.
+*/
+template <class T, class... Policies, class Alloc, class... Args>
+auto allocate_copy_on_write(const Alloc& alloc, Args&&... args)
+    -> copy_on_write<T,
+                     typename std::allocator_traits<Alloc>::template rebind_alloc<T>,
+                     Policies...> {
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    return copy_on_write<T, allocator_type, Policies...>(std::allocator_arg, allocator_type(alloc),
+                                                         std::forward<Args>(args)...);
+}
+
+/**************************************************************************************************/
+
+/*!
+    Obtains a non-const reference to the value of each copy_on_write in `[first, last)` and calls
+    `f` with each in turn, with the same result as calling `f(x.write())` for every element.
+
+    Every shared value is copied before `f` is called, and if a copy throws every element is left
+    unchanged. The references to the replaced values are then released together, with a single
+    update of the reference count for adjacent elements that shared the same value. When every
+    reference to a value is within the range, one element keeps the value and the others receive
+    copies, as with successive calls to write().
+
+    @param first, last A range of distinct copy_on_write objects.
+    @param f A function object invocable with `T&`.
+*/
+template <class I, class F>
+void write_all(I first, I last, F f) {
+    using cow_type = typename std::iterator_traits<I>::value_type;
+    using model = typename cow_type::model;
+    using observer = typename cow_type::observer;
+
+    struct shared_element {
+        cow_type* _object;
+        model* _source;
+        bool _keep = false;
+    };
+
+    std::vector<shared_element> shared;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                    typename std::iterator_traits<I>::iterator_category>) {
+        shared.reserve(static_cast<std::size_t>(std::distance(first, last)));
+    }
+    for (I i = first; i != last; ++i) {
+        cow_type& x = *i;
+        if (x.writable()) {
+            observer::on_write_inplace();
+        } else {
+            shared.push_back({&x, x._self});
+        }
+    }
+
+    /*
+        If every reference to a value is in the range, the last element referring to it keeps
+        the value, as it would be unique by the time write() reached it. Only values with no more
+        references than there are shared elements need to be grouped.
+    */
+    std::vector<std::size_t> order;
+    for (std::size_t n = 0; n != shared.size(); ++n) {
+        if (shared[n]._source->_count.use_count() <= shared.size()) order.push_back(n);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return std::less<model*>()(shared[a]._source, shared[b]._source);
+    });
+    for (auto group = order.begin(); group != order.end();) {
+        model* source = shared[*group]._source;
+        auto group_end = std::find_if(group, order.end(),
+                                      [&](std::size_t n) { return shared[n]._source != source; });
+        auto references = static_cast<std::size_t>(group_end - group);
+        // A value weak references refer to is not kept, so they do not observe the write.
+        if (source->_count.use_count() == references && !source->weak_referenced()) {
+            shared[*(group_end - 1)]._keep = true;
+        }
+        group = group_end;
+    }
+
+    // The sources are still referenced until released below, so a failed copy can be undone.
+    std::size_t installed = 0;
+    try {
+        for (; installed != shared.size(); ++installed) {
+            auto& e = shared[installed];
+            if (!e._keep) {
+                e._object->_self = cow_type::new_model(e._source->allocator(), e._source->_value);
+            }
+        }
+    } catch (...) {
+        for (std::size_t n = 0; n != installed; ++n) {
+            auto& e = shared[n];
+            if (e._keep) continue;
+            cow_type::delete_model(e._object->_self);
+            e._object->_self = e._source;
+        }
+        throw;
+    }
+
+    std::size_t references = 0;
+    for (std::size_t n = 0; n != shared.size(); ++n) {
+        auto& e = shared[n];
+        if (e._keep) {
+            observer::on_write_inplace();
+            continue;
+        }
+        observer::on_detach(observer::size(e._object->_self->_value));
+        ++references;
+        if (n + 1 != shared.size() && shared[n + 1]._source == e._source && !shared[n + 1]._keep)
+            continue;
+        if (e._source->_count.decrement(references)) {
+            observer::on_destroy(observer::size(e._source->_value));
+            cow_type::delete_model(e._source);
+        }
+        references = 0;
+    }
+
+    for (I i = first; i != last; ++i) {
+        cow_type& x = *i;
+        x._self->invalidate_hash();
+        f(x._self->_value);
+    }
+}
+
 /*!
-    The stlab namespace contains utilities and components for modern C++ development.
+    Calls write_all() on the copy_on_write objects in `range`.
 */
-namespace stlab {
+template <class R, class F>
+void write_all(R&& range, F f) {
+    using std::begin;
+    using std::end;
+    write_all(begin(range), end(range), std::move(f));
+}
+
+/**************************************************************************************************/
+
+namespace detail {
+
+template <class I>
+using enable_if_forward_iterator = std::enable_if_t<
+    std::is_base_of_v<std::forward_iterator_tag,
+                      typename std::iterator_traits<I>::iterator_category>>*;
+
+/*
+    Copies the `n` elements at `first` into the uninitialized storage at `out` in chunks of `chunk`
+    elements. Every chunk but the first is copied by a task passed to `executor`, while the calling
+    thread copies the first chunk and then waits for the others. If any chunk throws, the elements
+    copied by the other chunks are destroyed and the first exception is rethrown.
+*/
+template <class Executor, class T>
+void parallel_uninitialized_copy(Executor& executor,
+                                 const T* first,
+                                 std::size_t n,
+                                 T* out,
+                                 std::size_t chunk) {
+    chunk = std::max<std::size_t>(chunk, 1);
+    const std::size_t chunks = n / chunk + (n % chunk != 0);
+    if (chunks <= 1) {
+        std::uninitialized_copy_n(first, n, out);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t pending = chunks - 1;
+    std::exception_ptr error;
+    std::vector<char> copied(chunks, false);
+
+    auto copy_chunk = [&](std::size_t i) noexcept {
+        const std::size_t offset = i * chunk;
+        try {
+            std::uninitialized_copy_n(first + offset, std::min(chunk, n - offset), out + offset);
+            copied[i] = true;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    for (std::size_t i = 1; i != chunks; ++i) {
+        try {
+            executor([&, i]() noexcept {
+                copy_chunk(i);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) done.notify_one();
+            });
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+            pending -= chunks - i;
+            break;
+        }
+    }
+    copy_chunk(0);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return pending == 0; });
+    }
+    if (!error) return;
+
+    for (std::size_t i = 0; i != chunks; ++i) {
+        const std::size_t offset = i * chunk;
+        if (copied[i]) std::destroy_n(out + offset, std::min(chunk, n - offset));
+    }
+    std::rethrow_exception(error);
+}
+
+} // namespace detail
 
 /**************************************************************************************************/
 
 /*!
-    A copy-on-write wrapper for any type that models Regular.
+    A copy-on-write array of `T` with a size chosen at runtime.
 
-    Copy-on-write semantics allow for an object to be lazily copied - only creating a copy when
-    the value is modified and there is more than one reference to the value.
+    The reference count, the size and the elements are stored in a single block, so a variable
+    length buffer costs one allocation. The elements are read through the const accessors, and
+    write() returns a pointer to the elements, copying them first if they are shared.
 
-    This class is thread safe and supports types that model Moveable.
+    Accepts the same `Policies` as copy_on_write. With stlab::padded_count the elements start on a
+    separate cache line from the reference count. With stlab::bitwise_compare the elements are
+    compared with `std::memcmp`.
 */
-template <typename T> // T models Regular
-class copy_on_write {
-    struct model {
-        std::atomic<std::size_t> _count{1};
+template <typename T, typename... Policies> // T models Regular
+class copy_on_write<T[], Policies...> {
+    static_assert(detail::count_policy_v<detail::allocator_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one allocator");
+    static_assert(detail::count_policy_v<detail::threading_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one threading policy");
+    static_assert(detail::count_policy_v<detail::layout_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one layout policy");
+    static_assert(detail::count_policy_v<detail::instrumentation_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one instrumentation policy");
+    static_assert(detail::count_policy_v<detail::hashing_policy, Policies...> == 0,
+                  "copy_on_write<T[]> does not accept a hashing policy");
+    static_assert(detail::count_policy_v<detail::weak_policy, Policies...> == 0,
+                  "copy_on_write<T[]> does not accept a weak reference policy");
+    static_assert(detail::count_policy_v<detail::recycling_policy, Policies...> == 0,
+                  "copy_on_write<T[]> does not accept a recycling policy");
+    static_assert(detail::count_policy_v<detail::comparison_policy, Policies...> <= 1,
+                  "copy_on_write accepts at most one comparison policy");
+
+    using Alloc = detail::select_policy_t<detail::allocator_policy, std::allocator<T>, Policies...>;
+    using threading =
+        detail::select_policy_t<detail::threading_policy, multi_threaded, Policies...>;
+    using layout =
+        detail::select_policy_t<detail::layout_policy, detail::compact_layout, Policies...>;
+    using observer = typename detail::select_policy_t<detail::instrumentation_policy,
+                                                      instrumented<copy_on_write_observer>,
+                                                      Policies...>::observer;
+    using comparison =
+        detail::select_policy_t<detail::comparison_policy, detail::value_compare, Policies...>;
+    using count_type = detail::reference_count<threading>;
+
+    struct header : detail::allocator_holder<Alloc> {
+        alignas(layout::alignment) alignas(count_type) count_type _count;
+        std::size_t _size;
+
+        header(const Alloc& a, std::size_t n) noexcept :
+            detail::allocator_holder<Alloc>(a), _size(n) {}
+
+        constexpr explicit header(detail::immortal_t) noexcept :
+            _count(detail::immortal_t{}), _size(0) {}
+    };
 
-        model() noexcept(std::is_nothrow_constructible_v<T>) = default;
+    static constexpr std::size_t element_alignment = std::max(alignof(T), layout::alignment);
+    static constexpr std::size_t element_offset =
+        (sizeof(header) + element_alignment - 1) / element_alignment * element_alignment;
+    static constexpr std::size_t block_alignment = std::max(alignof(header), element_alignment);
 
-        template <class... Args>
-        explicit model(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) :
-            _value(std::forward<Args>(args)...) {}
+    /*
+        The unit of allocation. The header is placed at the start of the first block and the
+        elements follow at element_offset.
+    */
+    struct alignas(block_alignment) block {
+        unsigned char _data[block_alignment];
+    };
 
-        T _value;
+    using block_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<block>;
+    using block_traits = std::allocator_traits<block_allocator>;
+
+    struct alignas(block_alignment) default_block {
+        header _header;
     };
 
-    model* _self;
+    header* _self;
 
-    template <class U>
-    using disable_copy = std::enable_if_t<!std::is_same_v<std::decay_t<U>, copy_on_write>>*;
+    static constexpr auto block_count(std::size_t n) noexcept -> std::size_t {
+        return (element_offset + n * sizeof(T) + sizeof(block) - 1) / sizeof(block);
+    }
 
-    template <typename U>
-    using disable_copy_assign =
-        std::enable_if_t<!std::is_same_v<std::decay_t<U>, copy_on_write>, copy_on_write&>;
+    static auto elements(header* h) noexcept -> T* {
+        return static_cast<T*>(
+            static_cast<void*>(reinterpret_cast<unsigned char*>(h) + element_offset));
+    }
 
-    auto default_model() noexcept(std::is_nothrow_constructible_v<T>) -> model* {
-        static model default_s;
-        return &default_s;
+    /*
+        The header shared by all default constructed (empty) instances, see
+        copy_on_write::default_model(). With a stateless allocator it is constant initialized.
+    */
+    static auto default_header() noexcept -> header* {
+        static default_block default_s{header(detail::immortal_t{})};
+        return &default_s._header;
+    }
+
+    /*
+        Allocates a block for `n` elements, which are then constructed by `construct(p)`.
+    */
+    template <class F>
+    static auto new_header(const Alloc& a, std::size_t n, F construct) -> header* {
+        static_assert(std::is_same_v<typename block_traits::pointer, block*>,
+                      "copy_on_write requires an allocator with raw pointers");
+
+        if (n > (std::numeric_limits<std::size_t>::max() - element_offset - sizeof(block)) /
+                    sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+
+        block_allocator alloc{a};
+        block* p = block_traits::allocate(alloc, block_count(n));
+        assert((reinterpret_cast<std::uintptr_t>(p) % block_alignment == 0) &&
+               "FATAL (sparent) : allocator returned misaligned storage");
+
+        auto* h = ::new (static_cast<void*>(p)) header(a, n);
+        try {
+            construct(elements(h));
+        } catch (...) {
+            h->~header();
+            block_traits::deallocate(alloc, p, block_count(n));
+            throw;
+        }
+        return h;
+    }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+#endif
+    static void delete_header(header* h) noexcept {
+        block_allocator alloc{h->allocator()};
+        const std::size_t n = h->_size;
+        std::destroy_n(elements(h), n);
+        h->~header();
+        block_traits::deallocate(alloc, static_cast<block*>(static_cast<void*>(h)), block_count(n));
     }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    auto bytes() const noexcept -> std::size_t { return _self->_size * sizeof(T); }
+
+    struct adopt_t {};
+    static constexpr adopt_t adopt{};
+
+    /*
+        Takes ownership of a newly allocated header.
+    */
+    copy_on_write(adopt_t, header* p) noexcept : _self(p) {}
+
+    friend class atomic_copy_on_write<T[], Policies...>;
 
 public:
     /*!
-        @deprecated Use element_type instead. The type of value stored.
+        The type of the elements.
     */
-    /* [[deprecated]] */ using value_type = T;
+    using element_type = T;
 
     /*!
-        The type of value stored.
+        The type of the elements.
     */
-    using element_type = T;
+    using value_type = T;
 
     /*!
-        Default constructs the wrapped value.
+        The type of allocator used to allocate the elements.
     */
-    copy_on_write() noexcept(std::is_nothrow_constructible_v<T>) {
-        _self = default_model();
+    using allocator_type = Alloc;
 
-        // coverity[useless_call]
-        _self->_count.fetch_add(1, std::memory_order_relaxed);
+    using size_type = std::size_t;
+    using const_iterator = const T*;
+
+    /*!
+        Constructs an empty array. All default constructed instances share a single block and do
+        not modify any shared state.
+    */
+    copy_on_write() noexcept : _self(default_header()) {}
+
+    /*!
+        Constructs an array of `n` value initialized elements.
+    */
+    explicit copy_on_write(size_type n) : copy_on_write(std::allocator_arg, Alloc(), n) {}
+
+    /*!
+        Constructs an array of `n` copies of `x`.
+    */
+    copy_on_write(size_type n, const T& x) : copy_on_write(std::allocator_arg, Alloc(), n, x) {}
+
+    /*!
+        Constructs an array with a copy of the elements of `[first, last)`.
+    */
+    template <class I, detail::enable_if_forward_iterator<I> = nullptr>
+    copy_on_write(I first, I last) : copy_on_write(std::allocator_arg, Alloc(), first, last) {}
+
+    /*!
+        Constructs an array with a copy of the elements of `init`.
+    */
+    copy_on_write(std::initializer_list<T> init) :
+        copy_on_write(std::allocator_arg, Alloc(), init.begin(), init.end()) {}
+
+    /*!
+        Constructs an array of `n` value initialized elements allocated with `a`.
+    */
+    copy_on_write(std::allocator_arg_t, const allocator_type& a, size_type n) :
+        _self(new_header(a, n, [&](T* p) { std::uninitialized_value_construct_n(p, n); })) {
+        observer::on_construct(bytes());
     }
 
     /*!
-        Constructs a new instance by forwarding arguments to the wrapped value constructor.
+        Constructs an array of `n` copies of `x` allocated with `a`.
     */
-    template <class U>
-    copy_on_write(U&& x, disable_copy<U> = nullptr) : _self(new model(std::forward<U>(x))) {}
+    copy_on_write(std::allocator_arg_t, const allocator_type& a, size_type n, const T& x) :
+        _self(new_header(a, n, [&](T* p) { std::uninitialized_fill_n(p, n, x); })) {
+        observer::on_construct(bytes());
+    }
 
     /*!
-        Constructs a new instance by forwarding multiple arguments to the wrapped value constructor.
+        Constructs an array with a copy of the elements of `[first, last)` allocated with `a`.
     */
-    template <class U, class V, class... Args>
-    copy_on_write(U&& x, V&& y, Args&&... args) :
-        _self(new model(std::forward<U>(x), std::forward<V>(y), std::forward<Args>(args)...)) {}
+    template <class I, detail::enable_if_forward_iterator<I> = nullptr>
+    copy_on_write(std::allocator_arg_t, const allocator_type& a, I first, I last) :
+        _self(new_header(a, static_cast<size_type>(std::distance(first, last)),
+                         [&](T* p) { std::uninitialized_copy(first, last, p); })) {
+        observer::on_construct(bytes());
+    }
 
     /*!
-        Copy constructor that shares the underlying data with the source object.
+        Constructs an array with a copy of the elements of `init` allocated with `a`.
+    */
+    copy_on_write(std::allocator_arg_t, const allocator_type& a, std::initializer_list<T> init) :
+        copy_on_write(std::allocator_arg, a, init.begin(), init.end()) {}
+
+    /*!
+        Copy constructor that shares the elements with the source object.
     */
     copy_on_write(const copy_on_write& x) noexcept : _self(x._self) {
         assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
 
-        // coverity[useless_call]
-        _self->_count.fetch_add(1, std::memory_order_relaxed);
+        _self->_count.increment();
+        observer::on_share();
     }
 
     /*!
-        Move constructor that takes ownership of the source object's data.
+        Move constructor that takes ownership of the source object's elements.
     */
     copy_on_write(copy_on_write&& x) noexcept : _self{std::exchange(x._self, nullptr)} {
         assert(_self && "WARNING (sparent) : using a moved copy_on_write object");
     }
 
     ~copy_on_write() {
-        assert(!_self || ((_self->_count > 0) && "FATAL (sparent) : double delete"));
-        if (_self && (_self->_count.fetch_sub(1, std::memory_order_release) == 1)) {
-            std::atomic_thread_fence(std::memory_order_acquire);
-            if constexpr (std::is_default_constructible_v<element_type>) {
-                assert(_self != default_model());
-            }
-            delete _self;
+        assert(!_self || ((_self->_count.load() > 0) && "FATAL (sparent) : double delete"));
+        if (_self && _self->_count.decrement()) {
+            observer::on_destroy(bytes());
+            delete_header(_self);
         }
     }
 
     /*!
-        Copy assignment operator that shares the underlying data with the source object.
+        Copy assignment operator that shares the elements with the source object.
     */
     auto operator=(const copy_on_write& x) noexcept -> copy_on_write& {
         // self-assignment is not allowed to disable cert-oop54-cpp warning (and is likely a bug)
@@ -200,7 +2289,7 @@ public:
     }
 
     /*!
-        Move assignment operator that takes ownership of the source object's data.
+        Move assignment operator that takes ownership of the source object's elements.
     */
     auto operator=(copy_on_write&& x) noexcept -> copy_on_write& {
         auto tmp{std::move(x)};
@@ -209,101 +2298,148 @@ public:
     }
 
     /*!
-        Assigns a new value to the wrapped object, optimizing for in-place assignment when unique.
+        Obtains a pointer to the first of size() mutable elements.
+
+        This will copy the elements if necessary so changes do not affect other copy_on_write
+        objects sharing the same elements.
     */
-    template <class U>
-    auto operator=(U&& x) -> disable_copy_assign<U> {
-        if (_self && unique()) {
-            _self->_value = std::forward<U>(x);
-            return *this;
+    auto write() -> T* {
+        if (!unique()) {
+            *this = copy_on_write(adopt, new_header(_self->allocator(), size(), [&](T* p) {
+                                      std::uninitialized_copy(begin(), end(), p);
+                                  }));
+            observer::on_detach(bytes());
+        } else {
+            observer::on_write_inplace();
         }
 
-        return *this = copy_on_write(std::forward<U>(x));
+        return elements(_self);
     }
 
     /*!
-        Obtains a non-const reference to the underlying value.
+        Calls `f` with a pointer to the first of size() mutable elements if the object is unique.
+        Otherwise `f` is not called and the elements are neither copied nor allocated.
 
-        This will copy the underlying value if necessary so changes to the value do not affect
-        other copy_on_write objects sharing the same data.
+        @return True if `f` was called.
     */
-    auto write() -> element_type& {
-        if (!unique()) *this = copy_on_write(read());
+    template <class F>
+    auto try_write(F f) -> bool {
+        static_assert(std::is_invocable_v<F, T*>, "F must be invocable with T*");
 
-        return _self->_value;
+        if (!unique()) return false;
+
+        observer::on_write_inplace();
+        f(elements(_self));
+        return true;
     }
 
     /*!
-        If the object is not unique, the transform is applied to the underlying value to copy it and
-        a reference to the new value is returned. If the object is unique, the inplace function is
-        called with a reference to the underlying value and a reference to the value is returned.
+        Calls `f` with a pointer obtained from write(), copying the elements only if they are
+        shared, if `pred` returns true for a pointer to the first of size() const elements.
 
-        @param transform A function object that takes a const reference to the underlying value and
-        returns a new value.
-        @param inplace A function object that takes a reference to the underlying value and modifies
-        it in place.
+        @return True if `f` was called.
+    */
+    template <class Predicate, class F>
+    auto write_if(Predicate pred, F f) -> bool {
+        static_assert(std::is_invocable_r_v<bool, Predicate, const T*>,
+                      "Predicate must be invocable with const T*");
+        static_assert(std::is_invocable_v<F, T*>, "F must be invocable with T*");
 
-        @return A reference to the underlying value.
+        if (!pred(data())) return false;
+
+        f(write());
+        return true;
+    }
+
+    /*!
+        The default number of elements in each chunk copied by write(Executor, size_type).
     */
-    template <class Transform, class Inplace>
-    auto write(Transform transform, Inplace inplace) -> element_type& {
-        static_assert(std::is_invocable_r_v<T, Transform, const T&>,
-                      "Transform must be invocable with const T&");
-        static_assert(std::is_invocable_r_v<void, Inplace, T&>,
-                      "Inplace must be invocable with T&");
+    static constexpr size_type parallel_chunk_size =
+        std::max<size_type>(1, (size_type{1} << 18) / sizeof(T));
+
+    /*!
+        Obtains a pointer to the first of size() mutable elements, as write(), but copies the
+        elements in parallel if necessary.
+
+        The elements are copied in chunks of `chunk_size`, with every chunk but the first passed
+        as a nullary task to `executor`. The calling thread copies the first chunk and waits for
+        the rest, so detaching a large array takes time proportional to its size divided by the
+        number of threads serving the executor.
 
+        @param executor A function object invocable with a `void()` task.
+        @param chunk_size The number of elements copied by each task.
+    */
+    template <class Executor>
+    auto write(Executor executor, size_type chunk_size = parallel_chunk_size) -> T* {
         if (!unique()) {
-            *this = copy_on_write(transform(read()));
+            *this = copy_on_write(adopt, new_header(_self->allocator(), size(), [&](T* p) {
+                                      detail::parallel_uninitialized_copy(executor, data(), size(),
+                                                                          p, chunk_size);
+                                  }));
+            observer::on_detach(bytes());
         } else {
-            inplace(_self->_value);
+            observer::on_write_inplace();
         }
 
-        return _self->_value;
+        return elements(_self);
     }
 
     /*!
-        Returns a const reference to the underlying value for read-only access.
+        Returns the number of elements.
     */
-    [[nodiscard]] auto read() const noexcept -> const element_type& {
+    [[nodiscard]] auto size() const noexcept -> size_type {
         assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
 
-        return _self->_value;
+        return _self->_size;
     }
 
     /*!
-        Implicit conversion to const reference of the underlying value.
+        Returns true if the array has no elements.
     */
-    operator const element_type&() const noexcept { return read(); }
+    [[nodiscard]] auto empty() const noexcept -> bool { return size() == 0; }
 
     /*!
-        Dereference operator that returns a const reference to the underlying value.
+        Returns a pointer to the first of size() elements for read-only access.
     */
-    auto operator*() const noexcept -> const element_type& { return read(); }
+    [[nodiscard]] auto data() const noexcept -> const T* {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return elements(_self);
+    }
+
+    auto begin() const noexcept -> const_iterator { return data(); }
+    auto end() const noexcept -> const_iterator { return data() + size(); }
 
     /*!
-        Arrow operator that returns a const pointer to the underlying value.
+        Returns a const reference to the element at index `i`.
     */
-    auto operator->() const noexcept -> const element_type* { return &read(); }
+    auto operator[](size_type i) const noexcept -> const T& {
+        assert(i < size() && "index out of bounds");
 
-    /*!
-        Returns true if this is the only reference to the underlying object.
+        return data()[i];
+    }
 
-        This is useful to determine if calling write() will cause a copy.
+    /*!
+        Returns true if this is the only reference to the elements.
     */
     [[nodiscard]] auto unique() const noexcept -> bool {
         assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
 
-        return _self->_count.load(std::memory_order_acquire) == 1;
+        return _self->_count.unique();
     }
 
     /*!
-        @deprecated Use unique() instead. Returns true if this is the only reference to the
-       underlying object.
+        Returns the number of copy_on_write objects sharing the elements, see
+        copy_on_write::use_count().
     */
-    [[deprecated]] [[nodiscard]] auto unique_instance() const noexcept -> bool { return unique(); }
+    [[nodiscard]] auto use_count() const noexcept -> std::size_t {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->_count.use_count();
+    }
 
     /*!
-        Returns true if this object and the given object share the same underlying data.
+        Returns true if this object and the given object share the same elements.
     */
     [[nodiscard]] auto identity(const copy_on_write& x) const noexcept -> bool {
         assert((_self && x._self) && "FATAL (sparent) : using a moved copy_on_write object");
@@ -311,6 +2447,31 @@ public:
         return _self == x._self;
     }
 
+    /*!
+        Orders, hashes and compares objects by the elements they refer to, consistent with
+        identity(), as copy_on_write::owner_before(), owner_hash() and owner_equal().
+    */
+    [[nodiscard]] auto owner_before(const copy_on_write& x) const noexcept -> bool {
+        return std::less<const header*>()(_self, x._self);
+    }
+
+    [[nodiscard]] auto owner_hash() const noexcept -> std::size_t {
+        return std::hash<const header*>()(_self);
+    }
+
+    [[nodiscard]] auto owner_equal(const copy_on_write& x) const noexcept -> bool {
+        return _self == x._self;
+    }
+
+    /*!
+        Returns a copy of the allocator used to allocate the elements.
+    */
+    [[nodiscard]] auto get_allocator() const noexcept -> allocator_type {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write object");
+
+        return _self->allocator();
+    }
+
     /*!
         Efficiently swaps the contents of two copy_on_write objects.
     */
@@ -320,84 +2481,53 @@ public:
 
     /*! @{ */
     /*!
-        Comparisons can be done with the underlying value or the copy_on_write object.
+        Arrays compare lexicographically.
     */
-    friend inline auto operator<(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
-        return !x.identity(y) && (*x < *y);
+    friend inline auto operator==(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return x.identity(y) || comparison::equal(x.data(), x.size(), y.data(), y.size());
     }
 
-    friend inline auto operator<(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return *x < y;
+    friend inline auto operator!=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !(x == y);
     }
 
-    friend inline auto operator<(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return x < *y;
+    friend inline auto operator<(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
+        return !x.identity(y) && comparison::less(x.data(), x.size(), y.data(), y.size());
     }
 
     friend inline auto operator>(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
         return y < x;
     }
 
-    friend inline auto operator>(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return y < x;
-    }
-
-    friend inline auto operator>(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return y < x;
-    }
-
     friend inline auto operator<=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
         return !(y < x);
     }
 
-    friend inline auto operator<=(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return !(y < x);
-    }
-
-    friend inline auto operator<=(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return !(y < x);
-    }
-
     friend inline auto operator>=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
         return !(x < y);
     }
+    /*! @} */
+};
 
-    friend inline auto operator>=(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return !(x < y);
-    }
-
-    friend inline auto operator>=(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return !(x < y);
-    }
-
-    friend inline auto operator==(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
-        return x.identity(y) || (*x == *y);
-    }
-
-    friend inline auto operator==(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return *x == y;
-    }
+/**************************************************************************************************/
 
-    friend inline auto operator==(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return x == *y;
-    }
+} // namespace stlab
 
-    friend inline auto operator!=(const copy_on_write& x, const copy_on_write& y) noexcept -> bool {
-        return !(x == y);
-    }
+/**************************************************************************************************/
 
-    friend inline auto operator!=(const copy_on_write& x, const element_type& y) noexcept -> bool {
-        return !(x == y);
-    }
+namespace std {
 
-    friend inline auto operator!=(const element_type& x, const copy_on_write& y) noexcept -> bool {
-        return !(x == y);
-    }
-    /*! @} */
-};
-/**************************************************************************************************/
+/*!
+    Hashes a copy_on_write by its underlying value, see stlab::copy_on_write::hash(). The
+    specialization is disabled if the value cannot be hashed by the hashing policy's hasher.
+*/
+template <class T, class... Policies>
+struct hash<stlab::copy_on_write<T, Policies...>>
+    : stlab::detail::copy_on_write_hash<stlab::copy_on_write<T, Policies...>,
+                                        T,
+                                        stlab::detail::hasher_t<T, Policies...>> {};
 
-} // namespace stlab
+} // namespace std
 
 /**************************************************************************************************/
 
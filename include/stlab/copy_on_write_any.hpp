@@ -0,0 +1,238 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file copy_on_write_any.hpp
+    @brief A type-erased copy-on-write value
+
+    This file contains the implementation of stlab::copy_on_write_any, a copy-on-write value of
+    any type derived from a common base, stored in a single reference counted allocation.
+*/
+
+#ifndef STLAB_COPY_ON_WRITE_ANY_HPP
+#define STLAB_COPY_ON_WRITE_ANY_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cassert>
+#include <type_traits>
+#include <utility>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    A copy-on-write wrapper for a value of any type derived from `Base`, such as the commands of
+    an undo stack. It replaces `copy_on_write<std::unique_ptr<Base>>` with a single allocation
+    holding the reference count, a pointer to a table of operations for the concrete type, and the
+    value itself. read() is a single indirection, as the object caches a pointer to the `Base`
+    subobject, and write() copies the value with its copy constructor through the table rather
+    than with a virtual clone.
+
+    The concrete types must model Regular. Two objects compare equal if their values have the
+    same concrete type and compare equal as that type.
+
+    The reference count is atomic, as with stlab::multi_threaded.
+*/
+template <class Base>
+class copy_on_write_any {
+    struct header;
+
+    /*
+        The operations on a concrete type. One table exists for each type.
+    */
+    struct vtable {
+        auto (*copy)(const header*) -> copy_on_write_any;
+        void (*destroy)(header*) noexcept;
+        auto (*equal)(const header*, const header*) -> bool;
+    };
+
+    struct header {
+        detail::reference_count<multi_threaded> _count;
+        const vtable* _vtable;
+
+        explicit header(const vtable* v) noexcept : _vtable(v) {}
+    };
+
+    template <class D>
+    struct model : header {
+        D _value;
+
+        template <class... Args>
+        explicit model(Args&&... args) :
+            header(&vtable_for<D>), _value(std::forward<Args>(args)...) {}
+    };
+
+    template <class D>
+    static auto make(const D& x) -> copy_on_write_any {
+        auto* p = new model<D>(x);
+        return copy_on_write_any(p, &p->_value);
+    }
+
+    template <class D>
+    static constexpr vtable vtable_for{
+        [](const header* p) { return make(static_cast<const model<D>*>(p)->_value); },
+        [](header* p) noexcept { delete static_cast<model<D>*>(p); },
+        [](const header* p, const header* q) {
+            return p->_vtable == q->_vtable &&
+                   static_cast<const model<D>*>(p)->_value ==
+                       static_cast<const model<D>*>(q)->_value;
+        }};
+
+    header* _self;
+    Base* _object;
+
+    template <class D>
+    using enable_if_derived =
+        std::enable_if_t<std::is_base_of_v<Base, std::decay_t<D>> &&
+                         !std::is_same_v<std::decay_t<D>, copy_on_write_any>>*;
+
+    /*
+        Takes ownership of a newly allocated model.
+    */
+    copy_on_write_any(header* p, Base* object) noexcept : _self(p), _object(object) {}
+
+public:
+    /*!
+        The common base of the stored values.
+    */
+    using element_type = Base;
+
+    /*!
+        Constructs a new instance holding a copy of `x`, of type `std::decay_t<D>`.
+    */
+    template <class D, enable_if_derived<D> = nullptr>
+    copy_on_write_any(D&& x) : copy_on_write_any(std::in_place_type<std::decay_t<D>>,
+                                                 std::forward<D>(x)) {}
+
+    /*!
+        Constructs a new instance holding a value of type `D` constructed from `args`.
+    */
+    template <class D, class... Args>
+    explicit copy_on_write_any(std::in_place_type_t<D>, Args&&... args) {
+        static_assert(std::is_base_of_v<Base, D>, "D must be derived from Base");
+
+        auto* p = new model<D>(std::forward<Args>(args)...);
+        _self = p;
+        _object = &p->_value;
+    }
+
+    /*!
+        Copy constructor that shares the underlying value with the source object.
+    */
+    copy_on_write_any(const copy_on_write_any& x) noexcept : _self(x._self), _object(x._object) {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write_any object");
+
+        _self->_count.increment();
+    }
+
+    /*!
+        Move constructor that takes ownership of the source object's value.
+    */
+    copy_on_write_any(copy_on_write_any&& x) noexcept :
+        _self(std::exchange(x._self, nullptr)), _object(std::exchange(x._object, nullptr)) {}
+
+    ~copy_on_write_any() {
+        if (_self && _self->_count.decrement()) _self->_vtable->destroy(_self);
+    }
+
+    auto operator=(const copy_on_write_any& x) noexcept -> copy_on_write_any& {
+        return *this = copy_on_write_any(x);
+    }
+
+    auto operator=(copy_on_write_any&& x) noexcept -> copy_on_write_any& {
+        auto tmp{std::move(x)};
+        swap(*this, tmp);
+        return *this;
+    }
+
+    /*!
+        Obtains a non-const reference to the underlying value, copying it with the copy
+        constructor of its concrete type if it is shared.
+    */
+    auto write() -> Base& {
+        if (!unique()) *this = _self->_vtable->copy(_self);
+        return *_object;
+    }
+
+    /*!
+        Returns a const reference to the underlying value for read-only access.
+    */
+    [[nodiscard]] auto read() const noexcept -> const Base& {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write_any object");
+
+        return *_object;
+    }
+
+    /*!
+        Dereference operator that returns a const reference to the underlying value.
+    */
+    auto operator*() const noexcept -> const Base& { return read(); }
+
+    /*!
+        Arrow operator that returns a const pointer to the underlying value.
+    */
+    auto operator->() const noexcept -> const Base* { return &read(); }
+
+    /*!
+        Returns a const pointer to the underlying value if its concrete type is `D`, otherwise
+        nullptr. Unlike `dynamic_cast`, this compares a single pointer.
+    */
+    template <class D>
+    [[nodiscard]] auto target() const noexcept -> const D* {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write_any object");
+
+        if (_self->_vtable != &vtable_for<D>) return nullptr;
+        return &static_cast<const model<D>*>(_self)->_value;
+    }
+
+    /*!
+        Returns true if this is the only reference to the underlying value.
+    */
+    [[nodiscard]] auto unique() const noexcept -> bool {
+        assert(_self && "FATAL (sparent) : using a moved copy_on_write_any object");
+
+        return _self->_count.unique();
+    }
+
+    /*!
+        Returns true if this object and the given object share the same underlying value.
+    */
+    [[nodiscard]] auto identity(const copy_on_write_any& x) const noexcept -> bool {
+        assert((_self && x._self) && "FATAL (sparent) : using a moved copy_on_write_any object");
+
+        return _self == x._self;
+    }
+
+    friend inline void swap(copy_on_write_any& x, copy_on_write_any& y) noexcept {
+        std::swap(x._self, y._self);
+        std::swap(x._object, y._object);
+    }
+
+    friend inline auto operator==(const copy_on_write_any& x, const copy_on_write_any& y) -> bool {
+        return x.identity(y) || x._self->_vtable->equal(x._self, y._self);
+    }
+
+    friend inline auto operator!=(const copy_on_write_any& x, const copy_on_write_any& y) -> bool {
+        return !(x == y);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
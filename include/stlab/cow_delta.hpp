@@ -0,0 +1,185 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_delta.hpp
+    @brief A copy-on-write value modified by patches
+
+    This file contains the implementation of stlab::cow_delta, a copy-on-write value whose
+    modifications to a shared value are recorded as patches instead of copying the value.
+*/
+
+#ifndef STLAB_COW_DELTA_HPP
+#define STLAB_COW_DELTA_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    A value of type `T` with copy-on-write semantics, modified by applying objects of type
+    `Patch`, each a function object invocable with `T&` that makes a small change to the value.
+
+    A copy_on_write copies the whole value the first time a copy is written. A cow_delta instead
+    records a patch written to a shared value in a chain on top of the shared base value, so the
+    cost of the write is proportional to the size of the chain rather than the size of `T`. The
+    chain is compacted, by copying the base value once and applying the patches to it in order,
+    when it reaches `Threshold` patches or when the whole value is read with read() or written
+    with write(). A patch written when the base value is not shared is applied in place.
+
+    Readers that can resolve a query from the base value and the patches, such as looking up a
+    line of a document that a patch may have replaced, can use base() and patches() to avoid
+    compacting.
+*/
+template <class T, class Patch, std::size_t Threshold = 16>
+class cow_delta {
+    static_assert(Threshold > 0, "Threshold must be at least one patch");
+    static_assert(std::is_invocable_v<const Patch&, T&>, "Patch must be invocable with T&");
+
+    using patch_list = copy_on_write<std::vector<Patch>>;
+
+    copy_on_write<T> _base;
+    patch_list _patches;
+
+public:
+    /*!
+        The type of value stored.
+    */
+    using element_type = T;
+
+    /*!
+        The type of a patch.
+    */
+    using patch_type = Patch;
+
+    using size_type = std::size_t;
+
+    /*!
+        The number of patches at which the chain is compacted.
+    */
+    static constexpr size_type threshold = Threshold;
+
+    /*!
+        Default constructs the value, with no patches.
+    */
+    cow_delta() = default;
+
+    /*!
+        Constructs a new instance holding `x`, with no patches.
+    */
+    explicit cow_delta(copy_on_write<T> x) noexcept : _base(std::move(x)) {}
+
+    /*!
+        Applies `p` to the value. If the base value is shared, `p` is appended to the chain of
+        patches, compacting the chain if it reaches `Threshold` patches. Otherwise the chain is
+        compacted in place and `p` is applied to the value in place.
+    */
+    void write(Patch p) {
+        if (_base.unique()) {
+            compact();
+            p(_base.write());
+            return;
+        }
+
+        _patches.write().push_back(std::move(p));
+        if (_patches->size() >= Threshold) compact();
+    }
+
+    /*!
+        Obtains a non-const reference to the value, compacting the chain of patches and copying
+        the base value if it is shared, as copy_on_write::write().
+    */
+    auto write() -> T& {
+        compact();
+        return _base.write();
+    }
+
+    /*!
+        Returns a const reference to the value, first compacting the chain of patches if there
+        are any, which copies the base value if it is shared.
+
+        Unlike copy_on_write::read(), reading may modify the object, so it is not const.
+    */
+    auto read() -> const T& {
+        compact();
+        return _base.read();
+    }
+
+    /*!
+        Applies the chain of patches to the base value and clears the chain. The base value is
+        copied if it is shared and patched in place if it is not.
+
+        If a patch throws and the base value was shared, the object is unchanged. If it was not
+        shared, the object holds a valid but unspecified value.
+    */
+    void compact() {
+        if (_patches->empty()) return;
+
+        if (_base.unique()) {
+            patch_list patches = std::exchange(_patches, patch_list());
+            T& value = _base.write();
+            for (const Patch& p : *patches) p(value);
+            return;
+        }
+
+        copy_on_write<T> result(_base.read());
+        T& value = result.write();
+        for (const Patch& p : *_patches) p(value);
+        _base = std::move(result);
+        _patches = patch_list();
+    }
+
+    /*!
+        Returns a const reference to the base value, to which the patches have not been applied.
+    */
+    [[nodiscard]] auto base() const noexcept -> const T& { return _base.read(); }
+
+    /*!
+        Returns the chain of patches not yet applied to the base value, oldest first.
+    */
+    [[nodiscard]] auto patches() const noexcept -> const std::vector<Patch>& {
+        return _patches.read();
+    }
+
+    /*!
+        Returns true if there are no patches, so read() will not modify the object.
+    */
+    [[nodiscard]] auto compacted() const noexcept -> bool { return _patches->empty(); }
+
+    /*!
+        Returns true if this and `x` share the same base value and chain of patches.
+    */
+    [[nodiscard]] auto identity(const cow_delta& x) const noexcept -> bool {
+        return _base.identity(x._base) && _patches.identity(x._patches);
+    }
+
+    friend void swap(cow_delta& x, cow_delta& y) noexcept {
+        swap(x._base, y._base);
+        swap(x._patches, y._patches);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
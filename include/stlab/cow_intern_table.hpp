@@ -0,0 +1,156 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_intern_table.hpp
+    @brief Interning of copy_on_write values
+
+    This file contains the implementation of stlab::cow_intern_table, which collapses equal
+    copy_on_write values onto a single shared value.
+*/
+
+#ifndef STLAB_COW_INTERN_TABLE_HPP
+#define STLAB_COW_INTERN_TABLE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    A table of interned copy_on_write values. Interning a value returns a copy_on_write sharing
+    the value of an equal one interned earlier, if one is still alive, so that equal values built
+    separately share a single allocation and compare equal by identity().
+
+    `CopyOnWrite` is a copy_on_write with the stlab::weak_references policy. The table holds only
+    weak references, so an interned value is destroyed with its last user. The entry itself, and
+    the model block it refers to, are reclaimed when the table next looks up an equal hash or
+    purges expired entries, which it does each time the table doubles in size.
+
+    All member functions may be called concurrently.
+*/
+template <class CopyOnWrite,
+          class Hash = std::hash<typename CopyOnWrite::element_type>,
+          class KeyEqual = std::equal_to<typename CopyOnWrite::element_type>>
+class cow_intern_table {
+public:
+    using value_type = CopyOnWrite;
+    using element_type = typename CopyOnWrite::element_type;
+    using size_type = std::size_t;
+
+private:
+    using weak_type = typename CopyOnWrite::weak_type;
+
+    mutable std::mutex _mutex;
+    std::unordered_multimap<std::size_t, weak_type> _entries;
+    size_type _purge_size{16};
+    Hash _hash;
+    KeyEqual _equal;
+
+    /*
+        Returns the live interned value equal to `x`, erasing expired entries with its hash.
+        Must be called with the mutex held.
+    */
+    auto find(std::size_t h, const element_type& x) -> std::optional<value_type> {
+        auto [first, last] = _entries.equal_range(h);
+        while (first != last) {
+            if (auto result = first->second.lock()) {
+                if (_equal(**result, x)) return result;
+                ++first;
+            } else {
+                first = _entries.erase(first);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Must be called with the mutex held.
+    void insert(std::size_t h, const value_type& x) {
+        if (_entries.size() >= _purge_size) {
+            purge_locked();
+            _purge_size = std::max<size_type>(16, _entries.size() * 2);
+        }
+        _entries.emplace(h, weak_type(x));
+    }
+
+    void purge_locked() {
+        for (auto i = _entries.begin(); i != _entries.end();) {
+            i = i->second.expired() ? _entries.erase(i) : std::next(i);
+        }
+    }
+
+public:
+    cow_intern_table() = default;
+    cow_intern_table(const cow_intern_table&) = delete;
+    auto operator=(const cow_intern_table&) -> cow_intern_table& = delete;
+
+    /*!
+        Returns a copy_on_write sharing the interned value equal to `x`, or interns and returns `x`
+        if there is none.
+    */
+    auto intern(const value_type& x) -> value_type {
+        const std::size_t h = _hash(*x);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (auto result = find(h, *x)) return std::move(*result);
+        insert(h, x);
+        return x;
+    }
+
+    /*!
+        Returns a copy_on_write sharing the interned value equal to `x`, or interns and returns a
+        new copy_on_write holding `x` if there is none.
+    */
+    auto intern(element_type x) -> value_type {
+        const std::size_t h = _hash(x);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (auto result = find(h, x)) return std::move(*result);
+        value_type result(std::move(x));
+        insert(h, result);
+        return result;
+    }
+
+    /*!
+        Returns the number of entries, including entries whose value has been destroyed but which
+        have not yet been purged.
+    */
+    [[nodiscard]] auto size() const -> size_type {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    /*!
+        Erases the entries whose value has been destroyed.
+    */
+    void purge() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        purge_locked();
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,464 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_map.hpp
+    @brief A persistent hash map with structural sharing
+
+    This file contains the implementation of stlab::cow_map, a hash array mapped trie whose nodes
+    are copy_on_write values, so that modifying a copy only copies the nodes on the path to the
+    modified element.
+*/
+
+#ifndef STLAB_COW_MAP_HPP
+#define STLAB_COW_MAP_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+constexpr auto popcount(std::uint32_t x) noexcept -> unsigned {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    An unordered map from `Key` to `T` with copy-on-write semantics and structural sharing.
+
+    The map is a hash array mapped trie. Each node is a copy_on_write value indexed by five bits
+    of the hash of a key, so copying a cow_map shares every node. Inserting or erasing an element
+    of a copy copies only the nodes on the path to the element, O(log n) nodes of at most 32
+    entries, and leaves the rest of the trie shared. A node that is not shared is modified in
+    place, using the same unique() check as copy_on_write::write().
+
+    Elements are only accessible through const references. Keys whose hashes are equal in every
+    bit are kept in a single node and compared with `KeyEqual`.
+*/
+template <class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class cow_map {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+
+    /*!
+        The type of the elements. The key is not const, as the elements are never mutable.
+    */
+    using value_type = std::pair<Key, T>;
+
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using const_reference = const value_type&;
+
+private:
+    static constexpr unsigned bits_per_level = 5;
+    static constexpr unsigned hash_bits = std::numeric_limits<std::size_t>::digits;
+    static constexpr std::size_t max_depth =
+        (hash_bits + bits_per_level - 1) / bits_per_level + 1;
+
+    struct node;
+    using node_ptr = copy_on_write<node>;
+
+    struct leaf {
+        std::size_t _hash;
+        value_type _value;
+    };
+
+    using slot = std::variant<leaf, node_ptr>;
+
+    /*
+        A node has a slot for each bit set in `_bitmap`, in bit order. A node below the last
+        level of hash bits holds only leaves whose hashes are equal, and does not use `_bitmap`.
+    */
+    struct node {
+        std::uint32_t _bitmap{0};
+        std::vector<slot> _slots;
+    };
+
+    node_ptr _root;
+    size_type _size{0};
+    Hash _hash;
+    KeyEqual _equal;
+
+    static constexpr auto bit(std::size_t h, unsigned shift) noexcept -> std::uint32_t {
+        return std::uint32_t{1} << ((h >> shift) & ((1u << bits_per_level) - 1));
+    }
+
+    static constexpr auto offset(std::uint32_t bitmap, std::uint32_t bit) noexcept
+        -> std::size_t {
+        return detail::popcount(bitmap & (bit - 1));
+    }
+
+    auto matches(const leaf& l, std::size_t h, const Key& key) const -> bool {
+        return l._hash == h && _equal(l._value.first, key);
+    }
+
+    /*
+        Returns a node holding `a` and `b`, whose hashes have no differing bits below `shift`.
+        All nodes are allocated before either leaf is moved, so a failed allocation leaves both
+        leaves intact.
+    */
+    static auto make_node(leaf& a, leaf& b, unsigned shift) -> node_ptr {
+        node_ptr result{node()};
+        node* n = &result.write();
+        for (; shift < hash_bits && bit(a._hash, shift) == bit(b._hash, shift);
+             shift += bits_per_level) {
+            n->_bitmap = bit(a._hash, shift);
+            n->_slots.emplace_back(node_ptr{node()});
+            n = &std::get<node_ptr>(n->_slots.back()).write();
+        }
+        n->_slots.reserve(2);
+        leaf* first = &a;
+        leaf* second = &b;
+        if (shift < hash_bits) {
+            n->_bitmap = bit(a._hash, shift) | bit(b._hash, shift);
+            if (bit(b._hash, shift) < bit(a._hash, shift)) std::swap(first, second);
+        }
+        n->_slots.emplace_back(std::move(*first));
+        n->_slots.emplace_back(std::move(*second));
+        return result;
+    }
+
+    /*
+        Inserts `l` below `n`, or assigns its mapped value to an existing element with an equal
+        key if `assign` is true. Returns true if `l` was inserted.
+    */
+    auto insert(node& n, leaf& l, unsigned shift, bool assign) -> bool {
+        if (shift >= hash_bits) {
+            for (auto& e : n._slots) {
+                auto& existing = std::get<leaf>(e);
+                if (_equal(existing._value.first, l._value.first)) {
+                    if (assign) existing._value.second = std::move(l._value.second);
+                    return false;
+                }
+            }
+            n._slots.emplace_back(std::move(l));
+            return true;
+        }
+
+        const std::uint32_t b = bit(l._hash, shift);
+        const std::size_t pos = offset(n._bitmap, b);
+        if (!(n._bitmap & b)) {
+            n._slots.emplace(n._slots.begin() + static_cast<difference_type>(pos), std::move(l));
+            n._bitmap |= b;
+            return true;
+        }
+
+        slot& s = n._slots[pos];
+        if (auto* existing = std::get_if<leaf>(&s)) {
+            if (matches(*existing, l._hash, l._value.first)) {
+                if (assign) existing->_value.second = std::move(l._value.second);
+                return false;
+            }
+            s = make_node(*existing, l, shift + bits_per_level);
+            return true;
+        }
+        return insert(std::get<node_ptr>(s).write(), l, shift + bits_per_level, assign);
+    }
+
+    /*
+        Erases the element with `key`, which must be present below `n`. A node left holding a
+        single leaf is replaced by the leaf, so equal maps have the same shape.
+    */
+    void erase(node& n, std::size_t h, const Key& key, unsigned shift) {
+        if (shift >= hash_bits) {
+            for (auto i = n._slots.begin(); i != n._slots.end(); ++i) {
+                if (_equal(std::get<leaf>(*i)._value.first, key)) {
+                    n._slots.erase(i);
+                    return;
+                }
+            }
+            assert(false && "FATAL (sparent) : cow_map erased key not found");
+            return;
+        }
+
+        const std::uint32_t b = bit(h, shift);
+        assert((n._bitmap & b) && "FATAL (sparent) : cow_map erased key not found");
+        const std::size_t pos = offset(n._bitmap, b);
+        slot& s = n._slots[pos];
+        if (std::holds_alternative<leaf>(s)) {
+            n._slots.erase(n._slots.begin() + static_cast<difference_type>(pos));
+            n._bitmap &= ~b;
+            return;
+        }
+
+        node& child = std::get<node_ptr>(s).write();
+        erase(child, h, key, shift + bits_per_level);
+        if (child._slots.size() == 1 && std::holds_alternative<leaf>(child._slots.front())) {
+            leaf l = std::move(std::get<leaf>(child._slots.front()));
+            s = std::move(l);
+        }
+    }
+
+public:
+    /*!
+        A forward iterator over the elements of a cow_map, in an unspecified order.
+    */
+    class const_iterator {
+        struct frame {
+            const node* _node;
+            std::size_t _index;
+        };
+
+        std::array<frame, max_depth> _stack{};
+        std::size_t _depth{0};
+
+        friend class cow_map;
+
+        // Advances from the top frame to the next leaf, or to the end.
+        void settle() noexcept {
+            while (_depth) {
+                frame& f = _stack[_depth - 1];
+                if (f._index == f._node->_slots.size()) {
+                    if (--_depth) ++_stack[_depth - 1]._index;
+                    continue;
+                }
+                const slot& s = f._node->_slots[f._index];
+                if (std::holds_alternative<leaf>(s)) return;
+                _stack[_depth++] = {&std::get<node_ptr>(s).read(), 0};
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = cow_map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() noexcept = default;
+
+        auto operator*() const noexcept -> reference {
+            const frame& f = _stack[_depth - 1];
+            return std::get<leaf>(f._node->_slots[f._index])._value;
+        }
+        auto operator->() const noexcept -> pointer { return &**this; }
+
+        auto operator++() noexcept -> const_iterator& {
+            ++_stack[_depth - 1]._index;
+            settle();
+            return *this;
+        }
+        auto operator++(int) noexcept -> const_iterator {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        friend auto operator==(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            if (x._depth != y._depth) return false;
+            if (!x._depth) return true;
+            const frame& a = x._stack[x._depth - 1];
+            const frame& b = y._stack[y._depth - 1];
+            return a._node == b._node && a._index == b._index;
+        }
+        friend auto operator!=(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return !(x == y);
+        }
+    };
+
+    using iterator = const_iterator;
+
+    /*!
+        Constructs an empty map. Default constructed instances share an empty root node.
+    */
+    cow_map() = default;
+
+    /*!
+        Constructs a map with the elements of `[first, last)`. Of elements with equal keys, only
+        the first is inserted.
+    */
+    template <class I, detail::enable_if_forward_iterator<I> = nullptr>
+    cow_map(I first, I last) {
+        for (; first != last; ++first) insert(*first);
+    }
+
+    /*!
+        Constructs a map with the elements of `init`.
+    */
+    cow_map(std::initializer_list<value_type> init) : cow_map(init.begin(), init.end()) {}
+
+    /*!
+        Returns the number of elements.
+    */
+    [[nodiscard]] auto size() const noexcept -> size_type { return _size; }
+
+    /*!
+        Returns true if the map has no elements.
+    */
+    [[nodiscard]] auto empty() const noexcept -> bool { return _size == 0; }
+
+    [[nodiscard]] auto begin() const noexcept -> const_iterator {
+        const_iterator result;
+        result._stack[0] = {&_root.read(), 0};
+        result._depth = 1;
+        result.settle();
+        return result;
+    }
+
+    [[nodiscard]] auto end() const noexcept -> const_iterator { return {}; }
+
+    /*!
+        Returns an iterator to the element with `key`, or end() if there is none.
+    */
+    [[nodiscard]] auto find(const Key& key) const -> const_iterator {
+        const std::size_t h = _hash(key);
+        const_iterator result;
+        const node* n = &_root.read();
+        for (unsigned shift = 0;; shift += bits_per_level) {
+            auto& f = result._stack[result._depth++];
+            f._node = n;
+            if (shift >= hash_bits) {
+                for (f._index = 0; f._index != n->_slots.size(); ++f._index) {
+                    if (_equal(std::get<leaf>(n->_slots[f._index])._value.first, key)) {
+                        return result;
+                    }
+                }
+                return end();
+            }
+
+            const std::uint32_t b = bit(h, shift);
+            if (!(n->_bitmap & b)) return end();
+            f._index = offset(n->_bitmap, b);
+            const slot& s = n->_slots[f._index];
+            if (auto* l = std::get_if<leaf>(&s)) return matches(*l, h, key) ? result : end();
+            n = &std::get<node_ptr>(s).read();
+        }
+    }
+
+    /*!
+        Returns true if the map has an element with `key`.
+    */
+    [[nodiscard]] auto contains(const Key& key) const -> bool { return find(key) != end(); }
+
+    /*!
+        Returns the number of elements with `key`, zero or one.
+    */
+    [[nodiscard]] auto count(const Key& key) const -> size_type { return contains(key); }
+
+    /*!
+        Returns a const reference to the value mapped to `key`.
+
+        @throw std::out_of_range If the map has no element with `key`.
+    */
+    [[nodiscard]] auto at(const Key& key) const -> const T& {
+        auto i = find(key);
+        if (i == end()) throw std::out_of_range("stlab::cow_map::at key not found");
+        return i->second;
+    }
+
+    /*!
+        Inserts `x` if the map has no element with an equal key, copying only the nodes on the
+        path to the new element if they are shared.
+
+        @return True if `x` was inserted.
+    */
+    auto insert(value_type x) -> bool {
+        if (contains(x.first)) return false;
+        leaf l{_hash(x.first), std::move(x)};
+        insert(_root.write(), l, 0, false);
+        ++_size;
+        return true;
+    }
+
+    /*!
+        Inserts an element mapping `key` to `value`, or assigns `value` to the element with `key`.
+
+        @return True if an element was inserted.
+    */
+    auto insert_or_assign(Key key, T value) -> bool {
+        leaf l{_hash(key), value_type(std::move(key), std::move(value))};
+        const bool inserted = insert(_root.write(), l, 0, true);
+        _size += inserted;
+        return inserted;
+    }
+
+    /*!
+        Erases the element with `key`, copying only the nodes on the path to it if they are
+        shared. Nothing is copied if the map has no element with `key`.
+
+        @return The number of elements erased, zero or one.
+    */
+    auto erase(const Key& key) -> size_type {
+        if (!contains(key)) return 0;
+        erase(_root.write(), _hash(key), key, 0);
+        --_size;
+        return 1;
+    }
+
+    /*!
+        Removes all elements.
+    */
+    void clear() noexcept {
+        _root = node_ptr();
+        _size = 0;
+    }
+
+    /*!
+        Returns true if this and `x` share the same root node, and so the same elements.
+    */
+    [[nodiscard]] auto identity(const cow_map& x) const noexcept -> bool {
+        return _root.identity(x._root);
+    }
+
+    friend void swap(cow_map& x, cow_map& y) noexcept {
+        using std::swap;
+        swap(x._root, y._root);
+        swap(x._size, y._size);
+        swap(x._hash, y._hash);
+        swap(x._equal, y._equal);
+    }
+
+    friend auto operator==(const cow_map& x, const cow_map& y) -> bool {
+        if (x._size != y._size) return false;
+        if (x.identity(y)) return true;
+        for (const auto& e : x) {
+            auto i = y.find(e.first);
+            if (i == y.end() || !(i->second == e.second)) return false;
+        }
+        return true;
+    }
+
+    friend auto operator!=(const cow_map& x, const cow_map& y) -> bool { return !(x == y); }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
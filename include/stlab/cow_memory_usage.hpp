@@ -0,0 +1,162 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_memory_usage.hpp
+    @brief Memory accounting for sets of copy_on_write objects
+
+    This file contains the implementation of stlab::memory_usage, which reports how much of the
+    memory held by a set of copy_on_write objects is shared with objects outside the set.
+*/
+
+#ifndef STLAB_COW_MEMORY_USAGE_HPP
+#define STLAB_COW_MEMORY_USAGE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    The memory held by a set of copy_on_write objects, in bytes of their distinct values as
+    measured by the size function passed to stlab::memory_usage(). `total == unique + shared`.
+*/
+struct cow_memory {
+    /*!
+        The bytes of the distinct values referred to by the set.
+    */
+    std::size_t total{0};
+
+    /*!
+        The bytes of values referred to only by objects in the set, which destroying the set
+        would free.
+    */
+    std::size_t unique{0};
+
+    /*!
+        The bytes of values also referred to by objects outside the set.
+    */
+    std::size_t shared{0};
+
+    friend auto operator==(const cow_memory& x, const cow_memory& y) noexcept -> bool {
+        return x.total == y.total && x.unique == y.unique && x.shared == y.shared;
+    }
+
+    friend auto operator!=(const cow_memory& x, const cow_memory& y) noexcept -> bool {
+        return !(x == y);
+    }
+};
+
+/**************************************************************************************************/
+
+/*!
+    The default size function for stlab::memory_usage(), the size of the value itself, or of the
+    elements of a copy_on_write<T[]>. Values that own other memory, such as containers, need a
+    size function that includes it.
+*/
+struct value_size {
+    template <class T>
+    constexpr auto operator()(const T&) const noexcept -> std::size_t {
+        return sizeof(T);
+    }
+
+    template <class T>
+    constexpr auto operator()(const T*, std::size_t n) const noexcept -> std::size_t {
+        return sizeof(T) * n;
+    }
+};
+
+/**************************************************************************************************/
+
+namespace detail {
+
+struct owner_hash_indirect {
+    template <class Cow>
+    auto operator()(const Cow* x) const noexcept -> std::size_t {
+        return x->owner_hash();
+    }
+};
+
+struct owner_equal_indirect {
+    template <class Cow>
+    auto operator()(const Cow* x, const Cow* y) const noexcept -> bool {
+        return x->owner_equal(*y);
+    }
+};
+
+template <class Cow>
+constexpr bool is_array_copy_on_write_v = false;
+
+template <class T, class... Policies>
+constexpr bool is_array_copy_on_write_v<copy_on_write<T[], Policies...>> = true;
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    Returns the memory held by the copy_on_write objects in `[first, last)`, measuring each
+    distinct value once with `size`, invoked with a const reference to the value. For
+    copy_on_write<T[]> objects `size` is invoked with a pointer to the elements and their number.
+
+    A value is unique to the set if every reference to it is in the set, compared with
+    copy_on_write::use_count(), so an eviction policy can drop first the objects, such as undo
+    states, that free the most memory. The counts are read without synchronization, so the
+    result is exact only if no other thread copies or destroys objects sharing the values.
+*/
+template <class I, class Size = value_size>
+auto memory_usage(I first, I last, Size size = Size()) -> cow_memory {
+    using cow = typename std::iterator_traits<I>::value_type;
+    using element_type = typename cow::element_type;
+    constexpr bool is_array = detail::is_array_copy_on_write_v<cow>;
+    if constexpr (is_array) {
+        static_assert(
+            std::is_invocable_r_v<std::size_t, Size&, const element_type*, std::size_t>,
+            "Size must be invocable with const element_type* and std::size_t");
+    } else {
+        static_assert(std::is_invocable_r_v<std::size_t, Size&, const element_type&>,
+                      "Size must be invocable with const element_type& and return std::size_t");
+    }
+
+    std::unordered_map<const cow*, std::size_t, detail::owner_hash_indirect,
+                       detail::owner_equal_indirect>
+        references;
+    for (; first != last; ++first) ++references[&*first];
+
+    cow_memory result;
+    for (const auto& [x, n] : references) {
+        std::size_t bytes;
+        if constexpr (is_array) {
+            bytes = size(x->data(), x->size());
+        } else {
+            bytes = size(x->read());
+        }
+        result.total += bytes;
+        (x->use_count() == n ? result.unique : result.shared) += bytes;
+    }
+    return result;
+}
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,237 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_serialization.hpp
+    @brief Serialization of copy_on_write values that preserves sharing
+
+    This file contains the implementation of stlab::cow_writer and stlab::cow_reader, which write
+    each value shared by copy_on_write objects to a stream once and restore the sharing when the
+    stream is read.
+*/
+
+#ifndef STLAB_COW_SERIALIZATION_HPP
+#define STLAB_COW_SERIALIZATION_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    Each object is written as an unsigned LEB128 number: zero for a value that follows, otherwise
+    the index, from one, of the value previously written that the object shares.
+*/
+inline void write_varint(std::ostream& out, std::uint64_t n) {
+    while (n >= 0x80) {
+        out.put(static_cast<char>((n & 0x7f) | 0x80));
+        n >>= 7;
+    }
+    out.put(static_cast<char>(n));
+}
+
+inline auto read_varint(std::istream& in) -> std::uint64_t {
+    std::uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const auto c = in.get();
+        if (c == std::istream::traits_type::eof()) break;
+        result |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) return result;
+    }
+    in.setstate(std::ios_base::failbit);
+    throw std::ios_base::failure("stlab::cow_reader : malformed reference");
+}
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    Writes copy_on_write objects of type `Cow` to a stream, writing each shared value only the
+    first time an object referring to it is written, and a reference back to it for every later
+    object. An undo history of snapshots sharing most of their values is written in space
+    proportional to the distinct values rather than the number of snapshots.
+
+    Objects are written to the stream as they are passed to write(), so a history may be written
+    incrementally. The writer keeps a reference to each value written, so the identity of a value
+    is not reused for a different value by a later allocation, until the writer is destroyed.
+
+    The format of a value is chosen by the caller. A value that itself holds copy_on_write
+    objects may write them with another cow_writer on the same stream, so a graph of values is
+    written with all of its sharing.
+
+    The stream should be opened in binary mode.
+*/
+template <class Cow>
+class cow_writer {
+    std::ostream* _out;
+    std::unordered_map<Cow, std::uint64_t, owner_hash, owner_equal> _ids;
+    std::size_t _count{0};
+
+public:
+    /*!
+        The type of objects written.
+    */
+    using value_type = Cow;
+
+    /*!
+        The type of value stored by the objects written.
+    */
+    using element_type = typename Cow::element_type;
+
+    /*!
+        Constructs a writer to `out`.
+    */
+    explicit cow_writer(std::ostream& out) : _out(&out) {}
+
+    /*!
+        Writes `x`. If no object sharing its value has been written, `save` is called with the
+        stream and the value to write it.
+    */
+    template <class Save>
+    void write(const Cow& x, Save save) {
+        static_assert(std::is_invocable_v<Save, std::ostream&, const element_type&>,
+                      "Save must be invocable with std::ostream& and const element_type&");
+
+        ++_count;
+        auto [p, inserted] = _ids.try_emplace(x, _ids.size() + 1);
+        if (!inserted) {
+            detail::write_varint(*_out, p->second);
+            return;
+        }
+
+        detail::write_varint(*_out, 0);
+        save(*_out, x.read());
+    }
+
+    /*!
+        Writes `x`, writing the bytes of its value if it has not been written. Requires a
+        trivially copyable value, which is read back by cow_reader::read() on the same platform.
+    */
+    void write(const Cow& x) {
+        static_assert(std::is_trivially_copyable_v<element_type>,
+                      "write() without a save function requires a trivially copyable type");
+
+        write(x, [](std::ostream& out, const element_type& value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        });
+    }
+
+    /*!
+        Returns the number of objects written.
+    */
+    [[nodiscard]] auto count() const noexcept -> std::size_t { return _count; }
+
+    /*!
+        Returns the number of distinct values written.
+    */
+    [[nodiscard]] auto unique_count() const noexcept -> std::size_t { return _ids.size(); }
+};
+
+/**************************************************************************************************/
+
+/*!
+    Reads copy_on_write objects of type `Cow` written by stlab::cow_writer, in the order they
+    were written. Objects that shared a value when written share a single value when read.
+
+    Objects are read as they are requested, so a history may be read incrementally. The reader
+    keeps a reference to each distinct value read, so its memory is proportional to the distinct
+    values rather than the number of objects.
+*/
+template <class Cow>
+class cow_reader {
+    std::istream* _in;
+    std::vector<Cow> _values;
+
+public:
+    /*!
+        The type of objects read.
+    */
+    using value_type = Cow;
+
+    /*!
+        The type of value stored by the objects read.
+    */
+    using element_type = typename Cow::element_type;
+
+    /*!
+        Constructs a reader from `in`.
+    */
+    explicit cow_reader(std::istream& in) : _in(&in) {}
+
+    /*!
+        Reads an object. If its value was not previously read, `load` is called with the stream
+        and returns the value, which must be read in the format it was written in.
+
+        @throw std::ios_base::failure if the stream does not hold an object.
+    */
+    template <class Load>
+    auto read(Load load) -> Cow {
+        static_assert(std::is_invocable_r_v<element_type, Load, std::istream&>,
+                      "Load must be invocable with std::istream& and return element_type");
+
+        const std::uint64_t id = detail::read_varint(*_in);
+        if (id != 0) {
+            if (id > _values.size()) {
+                _in->setstate(std::ios_base::failbit);
+                throw std::ios_base::failure("stlab::cow_reader : reference to an unread value");
+            }
+            return _values[static_cast<std::size_t>(id - 1)];
+        }
+
+        Cow result(load(*_in));
+        if (!*_in) throw std::ios_base::failure("stlab::cow_reader : truncated value");
+        _values.push_back(result);
+        return result;
+    }
+
+    /*!
+        Reads an object written by cow_writer::write() with the bytes of its value.
+    */
+    auto read() -> Cow {
+        static_assert(std::is_trivially_copyable_v<element_type> &&
+                          std::is_default_constructible_v<element_type>,
+                      "read() without a load function requires a trivially copyable type");
+
+        return read([](std::istream& in) {
+            element_type value;
+            in.read(reinterpret_cast<char*>(&value), sizeof(value));
+            return value;
+        });
+    }
+
+    /*!
+        Returns the number of distinct values read.
+    */
+    [[nodiscard]] auto unique_count() const noexcept -> std::size_t { return _values.size(); }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
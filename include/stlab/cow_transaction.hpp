@@ -0,0 +1,253 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_transaction.hpp
+    @brief Staged writes to several copy_on_write objects, committed or rolled back together
+
+    This file contains the implementation of stlab::cow_transaction, which writes to copies of a
+    set of copy_on_write objects and then installs all of the copies or none of them.
+*/
+
+#ifndef STLAB_COW_TRANSACTION_HPP
+#define STLAB_COW_TRANSACTION_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    A transaction over copy_on_write objects, such as the fields touched by an undo step. write()
+    returns a reference to a staged copy of an object's value, detached from the object the first
+    time it is staged, and leaves the object unchanged. commit() swaps every staged copy into its
+    object, and rollback() drops the staged copies, each without copying or allocating.
+
+    Commit cannot fail, so either every staged write is installed or, if the transaction is
+    rolled back or an exception ends it early, none is. The objects must outlive the transaction
+    and must not be assigned while they are staged. A transaction is not thread safe.
+
+    The stages are kept in fixed blocks that are never moved, so references returned by write()
+    and read() remain valid while other objects are staged, even for types that store their value
+    inline. Stages are found by a linear search, which suits transactions over dozens of objects.
+    A transaction may be reused after commit() or rollback() and keeps its blocks, so a
+    transaction reused for every step does not allocate once it has grown.
+
+    The staged objects may be of any copy_on_write type, or any type with copy_on_write's copy,
+    nothrow move and swap, read() and write(), of size up to `staged_size`.
+*/
+class cow_transaction {
+public:
+    /*!
+        The largest size of an object that can be staged.
+    */
+    static constexpr std::size_t staged_size = 4 * sizeof(void*);
+
+private:
+    /*
+        The operations on a staged object of one type. One table exists for each type.
+    */
+    struct vtable {
+        void (*destroy)(void*) noexcept;
+        void (*commit)(void* target, void* staged) noexcept;
+    };
+
+    template <class Cow>
+    static constexpr vtable vtable_for{
+        [](void* p) noexcept { std::destroy_at(std::launder(static_cast<Cow*>(p))); },
+        [](void* target, void* staged) noexcept {
+            using std::swap;
+            swap(*static_cast<Cow*>(target), *std::launder(static_cast<Cow*>(staged)));
+        }};
+
+    /*
+        An object and its staged copy.
+    */
+    class stage {
+        const vtable* _vtable;
+        void* _target;
+        alignas(std::max_align_t) unsigned char _staged[staged_size];
+
+    public:
+        template <class Cow>
+        stage(Cow& target, std::in_place_type_t<Cow>) :
+            _vtable(&vtable_for<Cow>), _target(&target) {
+            ::new (static_cast<void*>(_staged)) Cow(target);
+        }
+
+        stage(const stage&) = delete;
+        auto operator=(const stage&) -> stage& = delete;
+
+        ~stage() { _vtable->destroy(_staged); }
+
+        [[nodiscard]] auto target() const noexcept -> const void* { return _target; }
+
+        template <class Cow>
+        [[nodiscard]] auto holds() const noexcept -> bool {
+            return _vtable == &vtable_for<Cow>;
+        }
+
+        template <class Cow>
+        auto staged() noexcept -> Cow& {
+            return *std::launder(reinterpret_cast<Cow*>(_staged));
+        }
+
+        void commit() noexcept { _vtable->commit(_target, _staged); }
+    };
+
+    static constexpr std::size_t stages_per_block = 16;
+
+    /*
+        Storage for stages. A staged object may store its value inline, so stages are constructed
+        in place and never moved.
+    */
+    struct block {
+        alignas(stage) unsigned char _storage[stages_per_block * sizeof(stage)];
+    };
+
+    std::vector<std::unique_ptr<block>> _blocks;
+    std::size_t _size{0};
+
+    auto slot(std::size_t n) noexcept -> void* {
+        return _blocks[n / stages_per_block]->_storage + n % stages_per_block * sizeof(stage);
+    }
+
+    auto at(std::size_t n) noexcept -> stage& {
+        return *std::launder(static_cast<stage*>(slot(n)));
+    }
+
+    template <class Cow>
+    auto push(Cow& x) -> stage& {
+        if (_size == _blocks.size() * stages_per_block) {
+            _blocks.push_back(std::make_unique<block>());
+        }
+        auto* e = ::new (slot(_size)) stage(x, std::in_place_type<Cow>);
+        ++_size;
+        return *e;
+    }
+
+    void pop() noexcept { std::destroy_at(&at(--_size)); }
+
+    void clear() noexcept {
+        while (_size) pop();
+    }
+
+    /*
+        An object and a subobject may share an address, so a stage is matched by its type too.
+    */
+    template <class Cow>
+    auto find(const Cow& x) -> Cow* {
+        for (std::size_t n = 0; n != _size; ++n) {
+            stage& e = at(n);
+            if (e.target() == &x && e.template holds<Cow>()) return &e.template staged<Cow>();
+        }
+        return nullptr;
+    }
+
+public:
+    cow_transaction() = default;
+    cow_transaction(const cow_transaction&) = delete;
+    auto operator=(const cow_transaction&) -> cow_transaction& = delete;
+
+    /*!
+        Rolls back any staged writes.
+    */
+    ~cow_transaction() { rollback(); }
+
+    /*!
+        Returns a reference, as `x.write()`, to the staged copy of `x`'s value. The first time `x`
+        is staged its value is copied, as by write() on a copy of `x`, and later calls return the
+        same staged value. `x` itself is not modified until commit().
+
+        If the copy throws, `x` is not staged.
+    */
+    template <class Cow>
+    auto write(Cow& x) -> decltype(std::declval<Cow&>().write()) {
+        static_assert(sizeof(Cow) <= staged_size &&
+                          alignof(Cow) <= alignof(std::max_align_t),
+                      "cow_transaction does not support an object of this size");
+        static_assert(std::is_nothrow_move_constructible_v<Cow> && std::is_nothrow_swappable_v<Cow>,
+                      "cow_transaction requires a nothrow move constructible and swappable type");
+
+        if (Cow* staged = find(x)) return staged->write();
+
+        stage& e = push(x);
+        try {
+            return e.template staged<Cow>().write();
+        } catch (...) {
+            pop();
+            throw;
+        }
+    }
+
+    /*!
+        Returns, as `x.read()`, the staged value of `x` if it is staged, otherwise the value of
+        `x`, so reads within the transaction see its writes.
+
+        The result is not invalidated by staging other objects. It is valid until the value is
+        next written or released, which for a staged value includes commit() and rollback() if
+        the value is stored inline.
+    */
+    template <class Cow>
+    [[nodiscard]] auto read(const Cow& x) -> decltype(std::declval<const Cow&>().read()) {
+        const Cow* staged = find(x);
+        return staged ? staged->read() : x.read();
+    }
+
+    /*!
+        Returns true if `x` has been staged by write().
+    */
+    template <class Cow>
+    [[nodiscard]] auto staged(const Cow& x) -> bool {
+        return find(x);
+    }
+
+    /*!
+        Returns the number of staged objects.
+    */
+    [[nodiscard]] auto size() const noexcept -> std::size_t { return _size; }
+
+    /*!
+        Returns true if no object is staged.
+    */
+    [[nodiscard]] auto empty() const noexcept -> bool { return _size == 0; }
+
+    /*!
+        Installs the staged copies into their objects and releases the objects' previous values.
+    */
+    void commit() noexcept {
+        for (std::size_t n = 0; n != _size; ++n) at(n).commit();
+        clear();
+    }
+
+    /*!
+        Drops the staged copies, leaving the objects unchanged.
+    */
+    void rollback() noexcept { clear(); }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
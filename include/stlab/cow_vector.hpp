@@ -0,0 +1,372 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file cow_vector.hpp
+    @brief A paged copy-on-write sequence
+
+    This file contains the implementation of stlab::cow_vector, a sequence whose elements are
+    stored in copy_on_write pages so that modifying a copy only copies the pages it touches.
+*/
+
+#ifndef STLAB_COW_VECTOR_HPP
+#define STLAB_COW_VECTOR_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    The default number of elements in a cow_vector page, sized so a page holds about 4 KiB.
+*/
+template <class T>
+constexpr std::size_t default_page_size = std::max<std::size_t>(1, 4096 / sizeof(T));
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    A sequence of `T` with copy-on-write semantics, stored as pages of `PageSize` elements.
+
+    Copying a cow_vector shares its pages, as copying a `copy_on_write<std::vector<T>>` shares its
+    elements. Modifying an element of a copy copies only the page holding the element and the
+    table of pages, so the cost of a detach is proportional to `PageSize` plus the number of pages
+    rather than to the number of elements.
+
+    Every page but the last holds exactly `PageSize` elements, so element `i` is found at offset
+    `i % PageSize` in page `i / PageSize`.
+*/
+template <class T, std::size_t PageSize = detail::default_page_size<T>>
+class cow_vector {
+    static_assert(PageSize > 0, "PageSize must be at least one element");
+
+    using page = copy_on_write<std::vector<T>>;
+
+    copy_on_write<std::vector<page>> _pages;
+    std::size_t _size{0};
+
+    /*
+        Returns a mutable reference to page `n`, copying the page table and the page if they are
+        shared.
+    */
+    auto write_page(std::size_t n) -> std::vector<T>& { return _pages.write()[n].write(); }
+
+    /*
+        Appends a page holding an element constructed from `args`. The page is built before it
+        is appended, so if the construction throws the sequence is unchanged.
+    */
+    template <class... Args>
+    auto append_page(Args&&... args) -> T& {
+        std::vector<T> elements;
+        elements.reserve(PageSize);
+        elements.emplace_back(std::forward<Args>(args)...);
+        auto& pages = _pages.write();
+        pages.emplace_back(std::move(elements));
+        return pages.back().write().back();
+    }
+
+public:
+    /*!
+        The type of the elements.
+    */
+    using value_type = T;
+
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_reference = const T&;
+
+    /*!
+        The number of elements in each page.
+    */
+    static constexpr size_type page_size = PageSize;
+
+    /*!
+        A random access iterator over the elements of a cow_vector.
+    */
+    class const_iterator {
+        const cow_vector* _vector{nullptr};
+        size_type _index{0};
+
+        friend class cow_vector;
+
+        const_iterator(const cow_vector* v, size_type i) noexcept : _vector(v), _index(i) {}
+
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() noexcept = default;
+
+        auto operator*() const noexcept -> reference { return (*_vector)[_index]; }
+        auto operator->() const noexcept -> pointer { return &**this; }
+        auto operator[](difference_type n) const noexcept -> reference { return *(*this + n); }
+
+        auto operator++() noexcept -> const_iterator& {
+            ++_index;
+            return *this;
+        }
+        auto operator++(int) noexcept -> const_iterator {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+        auto operator--() noexcept -> const_iterator& {
+            --_index;
+            return *this;
+        }
+        auto operator--(int) noexcept -> const_iterator {
+            auto result = *this;
+            --*this;
+            return result;
+        }
+        auto operator+=(difference_type n) noexcept -> const_iterator& {
+            _index = static_cast<size_type>(static_cast<difference_type>(_index) + n);
+            return *this;
+        }
+        auto operator-=(difference_type n) noexcept -> const_iterator& { return *this += -n; }
+
+        friend auto operator+(const_iterator x, difference_type n) noexcept -> const_iterator {
+            return x += n;
+        }
+        friend auto operator+(difference_type n, const_iterator x) noexcept -> const_iterator {
+            return x += n;
+        }
+        friend auto operator-(const_iterator x, difference_type n) noexcept -> const_iterator {
+            return x -= n;
+        }
+        friend auto operator-(const const_iterator& x, const const_iterator& y) noexcept
+            -> difference_type {
+            return static_cast<difference_type>(x._index) -
+                   static_cast<difference_type>(y._index);
+        }
+
+        friend auto operator==(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return x._index == y._index;
+        }
+        friend auto operator!=(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return !(x == y);
+        }
+        friend auto operator<(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return x._index < y._index;
+        }
+        friend auto operator>(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return y < x;
+        }
+        friend auto operator<=(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return !(y < x);
+        }
+        friend auto operator>=(const const_iterator& x, const const_iterator& y) noexcept -> bool {
+            return !(x < y);
+        }
+    };
+
+    using iterator = const_iterator;
+
+    /*!
+        Constructs an empty sequence. Default constructed instances share an empty page table.
+    */
+    cow_vector() noexcept = default;
+
+    /*!
+        Constructs a sequence of `n` value initialized elements.
+    */
+    explicit cow_vector(size_type n) : cow_vector(n, T()) {}
+
+    /*!
+        Constructs a sequence of `n` copies of `x`.
+    */
+    cow_vector(size_type n, const T& x) {
+        std::vector<page> pages;
+        pages.reserve((n + PageSize - 1) / PageSize);
+        for (size_type remaining = n; remaining != 0;) {
+            const size_type count = std::min(remaining, PageSize);
+            std::vector<T> elements;
+            elements.reserve(PageSize);
+            elements.assign(count, x);
+            pages.emplace_back(std::move(elements));
+            remaining -= count;
+        }
+        _pages = copy_on_write<std::vector<page>>(std::move(pages));
+        _size = n;
+    }
+
+    /*!
+        Constructs a sequence with a copy of the elements of `[first, last)`.
+    */
+    template <class I, detail::enable_if_forward_iterator<I> = nullptr>
+    cow_vector(I first, I last) {
+        for (; first != last; ++first) push_back(*first);
+    }
+
+    /*!
+        Constructs a sequence with a copy of the elements of `init`.
+    */
+    cow_vector(std::initializer_list<T> init) : cow_vector(init.begin(), init.end()) {}
+
+    /*!
+        Returns the number of elements.
+    */
+    [[nodiscard]] auto size() const noexcept -> size_type { return _size; }
+
+    /*!
+        Returns true if the sequence has no elements.
+    */
+    [[nodiscard]] auto empty() const noexcept -> bool { return _size == 0; }
+
+    /*!
+        Returns a const reference to element `i`, which must be less than size().
+    */
+    [[nodiscard]] auto operator[](size_type i) const noexcept -> const T& {
+        assert(i < _size && "FATAL (sparent) : cow_vector index out of range");
+
+        return (*_pages)[i / PageSize].read()[i % PageSize];
+    }
+
+    /*!
+        Returns a const reference to the first element. The sequence must not be empty.
+    */
+    [[nodiscard]] auto front() const noexcept -> const T& { return (*this)[0]; }
+
+    /*!
+        Returns a const reference to the last element. The sequence must not be empty.
+    */
+    [[nodiscard]] auto back() const noexcept -> const T& { return (*this)[_size - 1]; }
+
+    [[nodiscard]] auto begin() const noexcept -> const_iterator { return {this, 0}; }
+    [[nodiscard]] auto end() const noexcept -> const_iterator { return {this, _size}; }
+
+    /*!
+        Obtains a non-const reference to element `i`, which must be less than size().
+
+        This will copy the page holding the element, and the table of pages, if they are shared
+        with another cow_vector. No other page is copied.
+    */
+    auto write(size_type i) -> T& {
+        assert(i < _size && "FATAL (sparent) : cow_vector index out of range");
+
+        return write_page(i / PageSize)[i % PageSize];
+    }
+
+    /*!
+        Appends a copy of `x`, copying only the last page if it is shared.
+    */
+    void push_back(const T& x) { emplace_back(x); }
+
+    /*!
+        Appends `x`, copying only the last page if it is shared.
+    */
+    void push_back(T&& x) { emplace_back(std::move(x)); }
+
+    /*!
+        Appends an element constructed from `args`, copying only the last page if it is shared.
+
+        If the construction throws, the sequence is unchanged.
+
+        @return A reference to the new element, valid until this sequence is next modified.
+    */
+    template <class... Args>
+    auto emplace_back(Args&&... args) -> T& {
+        if (_size % PageSize == 0) {
+            T& result = append_page(std::forward<Args>(args)...);
+            ++_size;
+            return result;
+        }
+        auto& elements = write_page(_size / PageSize);
+        elements.emplace_back(std::forward<Args>(args)...);
+        ++_size;
+        return elements.back();
+    }
+
+    /*!
+        Removes the last element. The sequence must not be empty.
+    */
+    void pop_back() {
+        assert(_size && "FATAL (sparent) : pop_back on an empty cow_vector");
+
+        --_size;
+        if (_size % PageSize == 0) {
+            _pages.write().pop_back();
+        } else {
+            write_page(_size / PageSize).pop_back();
+        }
+    }
+
+    /*!
+        Removes all elements.
+    */
+    void clear() noexcept {
+        _pages = copy_on_write<std::vector<page>>();
+        _size = 0;
+    }
+
+    /*!
+        Returns true if this and `x` share the same table of pages, and so the same elements.
+    */
+    [[nodiscard]] auto identity(const cow_vector& x) const noexcept -> bool {
+        return _pages.identity(x._pages);
+    }
+
+    friend void swap(cow_vector& x, cow_vector& y) noexcept {
+        swap(x._pages, y._pages);
+        std::swap(x._size, y._size);
+    }
+
+    friend auto operator==(const cow_vector& x, const cow_vector& y) -> bool {
+        if (x._size != y._size) return false;
+        if (x.identity(y)) return true;
+
+        const auto& a = *x._pages;
+        const auto& b = *y._pages;
+        for (size_type n = 0; n != a.size(); ++n) {
+            if (!a[n].identity(b[n]) && a[n] != b[n]) return false;
+        }
+        return true;
+    }
+
+    friend auto operator!=(const cow_vector& x, const cow_vector& y) -> bool { return !(x == y); }
+
+    friend auto operator<(const cow_vector& x, const cow_vector& y) -> bool {
+        return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
+    }
+
+    friend auto operator>(const cow_vector& x, const cow_vector& y) -> bool { return y < x; }
+
+    friend auto operator<=(const cow_vector& x, const cow_vector& y) -> bool { return !(y < x); }
+
+    friend auto operator>=(const cow_vector& x, const cow_vector& y) -> bool { return !(x < y); }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,362 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file inline_copy_on_write.hpp
+    @brief Inline storage for small copy_on_write values
+
+    This file contains the implementation of stlab::inline_copy_on_write, which stores a small
+    value inline with the copy_on_write interface, and of stlab::small_copy_on_write, which
+    selects between it and copy_on_write by the size of the value.
+*/
+
+#ifndef STLAB_INLINE_COPY_ON_WRITE_HPP
+#define STLAB_INLINE_COPY_ON_WRITE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    The largest size, in bytes, of a value stored inline by stlab::small_copy_on_write.
+*/
+constexpr std::size_t small_object_size = 64;
+
+/*!
+    True if `T` is trivially copyable, no larger than stlab::small_object_size and not
+    over-aligned, so copying it is cheaper than allocating and counting references to it.
+*/
+template <class T>
+constexpr bool is_small_object_v = std::is_trivially_copyable_v<T> &&
+                                   sizeof(T) <= small_object_size &&
+                                   alignof(T) <= alignof(std::max_align_t);
+
+/**************************************************************************************************/
+
+/*!
+    A value of type `T` stored inline, with the interface of copy_on_write. Copying an
+    inline_copy_on_write copies the value, so every instance is unique and write() never copies.
+
+    This is the representation chosen by stlab::small_copy_on_write for small trivially copyable
+    types, for which a heap allocation and an atomic reference count cost more than the copy
+    they save.
+*/
+template <class T>
+class inline_copy_on_write {
+    T _value;
+
+    template <class U>
+    using disable_copy =
+        std::enable_if_t<!std::is_same_v<std::decay_t<U>, inline_copy_on_write>>*;
+
+    template <typename U>
+    using disable_copy_assign =
+        std::enable_if_t<!std::is_same_v<std::decay_t<U>, inline_copy_on_write>,
+                         inline_copy_on_write&>;
+
+    template <class U>
+    using enable_hash =
+        std::enable_if_t<std::is_invocable_r_v<std::size_t, std::hash<U>, const U&>>*;
+
+public:
+    /*!
+        @deprecated Use element_type instead. The type of value stored.
+    */
+    /* [[deprecated]] */ using value_type = T;
+
+    /*!
+        The type of value stored.
+    */
+    using element_type = T;
+
+    /*!
+        Value initializes the wrapped value.
+    */
+    inline_copy_on_write() noexcept(std::is_nothrow_default_constructible_v<T>) : _value() {}
+
+    /*!
+        Constructs a new instance by forwarding arguments to the wrapped value constructor.
+    */
+    template <class U>
+    inline_copy_on_write(U&& x, disable_copy<U> = nullptr) : _value(std::forward<U>(x)) {}
+
+    /*!
+        Constructs a new instance by forwarding multiple arguments to the wrapped value
+        constructor.
+    */
+    template <class U, class V, class... Args>
+    inline_copy_on_write(U&& x, V&& y, Args&&... args) :
+        _value(std::forward<U>(x), std::forward<V>(y), std::forward<Args>(args)...) {}
+
+    /*!
+        Assigns a new value to the wrapped object.
+    */
+    template <class U>
+    auto operator=(U&& x) -> disable_copy_assign<U> {
+        _value = std::forward<U>(x);
+        return *this;
+    }
+
+    /*!
+        Obtains a non-const reference to the underlying value.
+    */
+    auto write() noexcept -> element_type& { return _value; }
+
+    /*!
+        Calls `inplace` with a reference to the underlying value, as the value is always unique,
+        and returns a reference to the value.
+    */
+    template <class Transform, class Inplace>
+    auto write(Transform, Inplace inplace) -> element_type& {
+        static_assert(std::is_invocable_r_v<T, Transform, const T&>,
+                      "Transform must be invocable with const T&");
+        static_assert(std::is_invocable_r_v<void, Inplace, T&>,
+                      "Inplace must be invocable with T&");
+
+        inplace(_value);
+        return _value;
+    }
+
+    /*!
+        Calls `f` with a non-const reference to the underlying value and returns true, as the
+        value is always unique.
+    */
+    template <class F>
+    auto try_write(F f) -> bool {
+        static_assert(std::is_invocable_v<F, T&>, "F must be invocable with T&");
+
+        f(_value);
+        return true;
+    }
+
+    /*!
+        Calls `f` with a non-const reference to the underlying value if `pred` returns true for
+        it.
+
+        @return True if `f` was called.
+    */
+    template <class Predicate, class F>
+    auto write_if(Predicate pred, F f) -> bool {
+        static_assert(std::is_invocable_r_v<bool, Predicate, const T&>,
+                      "Predicate must be invocable with const T&");
+        static_assert(std::is_invocable_v<F, T&>, "F must be invocable with T&");
+
+        if (!pred(_value)) return false;
+
+        f(_value);
+        return true;
+    }
+
+    /*!
+        Returns a copy of the underlying value.
+    */
+    [[nodiscard]] auto extract() && noexcept -> element_type { return _value; }
+
+    /*!
+        Returns a const reference to the underlying value for read-only access.
+    */
+    [[nodiscard]] auto read() const noexcept -> const element_type& { return _value; }
+
+    /*!
+        Implicit conversion to const reference of the underlying value.
+    */
+    operator const element_type&() const noexcept { return read(); }
+
+    /*!
+        Dereference operator that returns a const reference to the underlying value.
+    */
+    auto operator*() const noexcept -> const element_type& { return read(); }
+
+    /*!
+        Arrow operator that returns a const pointer to the underlying value.
+    */
+    auto operator->() const noexcept -> const element_type* { return &read(); }
+
+    /*!
+        Returns true. The value is never shared.
+    */
+    [[nodiscard]] constexpr auto unique() const noexcept -> bool { return true; }
+
+    /*!
+        Returns true if this and `x` are the same object, as the value is never shared.
+    */
+    [[nodiscard]] auto identity(const inline_copy_on_write& x) const noexcept -> bool {
+        return this == &x;
+    }
+
+    /*!
+        Returns the hash of the underlying value. Only available if `std::hash<T>` is enabled.
+    */
+    template <class U = T, enable_hash<U> = nullptr>
+    [[nodiscard]] auto hash() const noexcept(noexcept(std::hash<U>()(std::declval<const U&>())))
+        -> std::size_t {
+        return std::hash<U>()(_value);
+    }
+
+    friend inline void swap(inline_copy_on_write& x, inline_copy_on_write& y) noexcept {
+        std::swap(x._value, y._value);
+    }
+
+    /*!
+        Comparisons can be done with the underlying value or the inline_copy_on_write object.
+    */
+    friend inline auto operator<(const inline_copy_on_write& x,
+                                 const inline_copy_on_write& y) noexcept -> bool {
+        return *x < *y;
+    }
+
+    friend inline auto operator<(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return *x < y;
+    }
+
+    friend inline auto operator<(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return x < *y;
+    }
+
+    friend inline auto operator>(const inline_copy_on_write& x,
+                                 const inline_copy_on_write& y) noexcept -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator>(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator>(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return y < x;
+    }
+
+    friend inline auto operator<=(const inline_copy_on_write& x,
+                                  const inline_copy_on_write& y) noexcept -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator<=(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator<=(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return !(y < x);
+    }
+
+    friend inline auto operator>=(const inline_copy_on_write& x,
+                                  const inline_copy_on_write& y) noexcept -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator>=(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator>=(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return !(x < y);
+    }
+
+    friend inline auto operator==(const inline_copy_on_write& x,
+                                  const inline_copy_on_write& y) noexcept -> bool {
+        return *x == *y;
+    }
+
+    friend inline auto operator==(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return *x == y;
+    }
+
+    friend inline auto operator==(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return x == *y;
+    }
+
+    friend inline auto operator!=(const inline_copy_on_write& x,
+                                  const inline_copy_on_write& y) noexcept -> bool {
+        return !(x == y);
+    }
+
+    friend inline auto operator!=(const inline_copy_on_write& x, const element_type& y) noexcept
+        -> bool {
+        return !(x == y);
+    }
+
+    friend inline auto operator!=(const element_type& x, const inline_copy_on_write& y) noexcept
+        -> bool {
+        return !(x == y);
+    }
+};
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    True if each of `Policies` only affects how a shared value is allocated, counted or laid out,
+    and so can be ignored for a value stored inline.
+*/
+template <class... Policies>
+constexpr bool inline_policies_v = count_policy_v<allocator_policy, Policies...> +
+                                       count_policy_v<threading_policy, Policies...> +
+                                       count_policy_v<layout_policy, Policies...> ==
+                                   sizeof...(Policies);
+
+} // namespace detail
+
+/*!
+    A copy-on-write wrapper for `T` whose representation is chosen at compile time:
+    stlab::inline_copy_on_write if `T` satisfies stlab::is_small_object_v, and
+    copy_on_write<T, Policies...> otherwise. Generic code can wrap every type uniformly and small
+    values are copied rather than shared.
+
+    The allocator, threading and layout policies have no effect on a value stored inline. Any
+    other policy, such as stlab::weak_references or stlab::cached_hash, is not supported by
+    inline_copy_on_write, so with one the representation is always copy_on_write.
+*/
+template <class T, class... Policies>
+using small_copy_on_write =
+    std::conditional_t<is_small_object_v<T> && detail::inline_policies_v<Policies...>,
+                       inline_copy_on_write<T>,
+                       copy_on_write<T, Policies...>>;
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+namespace std {
+
+/*!
+    Hashes an inline_copy_on_write by its underlying value. Disabled if `std::hash<T>` is.
+*/
+template <class T>
+struct hash<stlab::inline_copy_on_write<T>>
+    : stlab::detail::copy_on_write_hash<stlab::inline_copy_on_write<T>, T, std::hash<T>> {};
+
+} // namespace std
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,443 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file interprocess_copy_on_write.hpp
+    @brief Copy-on-write values shared between processes
+
+    This file contains the implementation of stlab::cow_segment, a region of shared memory holding
+    copy-on-write values, and of stlab::interprocess_copy_on_write, a copy_on_write whose value
+    may live in a segment mapped by several processes.
+*/
+
+#ifndef STLAB_INTERPROCESS_COPY_ON_WRITE_HPP
+#define STLAB_INTERPROCESS_COPY_ON_WRITE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/*
+    The start of a formatted segment. Everything in the segment is addressed by its offset from
+    the start, so each process may map the segment at a different address. The free list is kept
+    sorted by offset so adjacent free blocks can be merged.
+*/
+struct segment_header {
+    static constexpr std::uint64_t magic = 0x73746c6162636f77; // "stlabcow"
+
+    std::uint64_t _magic;
+    std::uint64_t _size;
+    std::atomic<bool> _locked{false};
+    std::uint64_t _free;
+};
+
+/*
+    A free block, or the header of an allocated block.
+*/
+struct segment_block {
+    std::uint64_t _size;
+    std::uint64_t _next;
+};
+
+static_assert(std::atomic<bool>::is_always_lock_free &&
+                  std::atomic<std::size_t>::is_always_lock_free,
+              "interprocess_copy_on_write requires address-free lock-free atomics");
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+/*!
+    A region of memory, typically shared memory or a shared memory-mapped file, holding
+    the values of stlab::interprocess_copy_on_write objects. A cow_segment is a lightweight handle
+    to the region; the user maps and unmaps the memory.
+
+    Each process opens the segment at whatever address it is mapped. Values are allocated from the
+    segment under a spin lock stored in it, so any process may allocate and free values.
+*/
+class cow_segment {
+    unsigned char* _base{nullptr};
+
+    auto header() const noexcept -> detail::segment_header* {
+        return std::launder(reinterpret_cast<detail::segment_header*>(_base));
+    }
+
+    auto block(std::uint64_t offset) const noexcept -> detail::segment_block* {
+        return std::launder(reinterpret_cast<detail::segment_block*>(_base + offset));
+    }
+
+    class lock {
+        std::atomic<bool>& _locked;
+
+    public:
+        explicit lock(std::atomic<bool>& locked) noexcept : _locked(locked) {
+            while (_locked.exchange(true, std::memory_order_acquire)) {
+                while (_locked.load(std::memory_order_relaxed)) {}
+            }
+        }
+        lock(const lock&) = delete;
+        auto operator=(const lock&) -> lock& = delete;
+
+        ~lock() { _locked.store(false, std::memory_order_release); }
+    };
+
+    explicit cow_segment(unsigned char* base) noexcept : _base(base) {}
+
+    template <class T>
+    friend class interprocess_copy_on_write;
+
+public:
+    /*!
+        The alignment of the start of a segment and of the values allocated in it.
+    */
+    static constexpr std::size_t alignment = 64;
+
+    /*!
+        Constructs a handle to no segment.
+    */
+    cow_segment() noexcept = default;
+
+    /*!
+        Formats the `size` bytes of memory at `base`, aligned to `alignment`, as an empty segment
+        and returns a handle to it. Any previous contents are discarded.
+    */
+    static auto create(void* base, std::size_t size) noexcept -> cow_segment {
+        assert((reinterpret_cast<std::uintptr_t>(base) % alignment == 0) &&
+               "FATAL (sparent) : misaligned cow_segment");
+        assert(size >= 2 * alignment && "FATAL (sparent) : cow_segment too small");
+
+        auto* p = static_cast<unsigned char*>(base);
+        cow_segment result(p);
+        const std::uint64_t first = alignment;
+        ::new (p) detail::segment_header{detail::segment_header::magic, size, {false}, first};
+        ::new (p + first) detail::segment_block{(size - first) / alignment * alignment, 0};
+        return result;
+    }
+
+    /*!
+        Returns a handle to the segment created at `base`, which may be mapped at a different
+        address than it was created at.
+    */
+    static auto open(void* base) noexcept -> cow_segment {
+        cow_segment result(static_cast<unsigned char*>(base));
+        assert(result.header()->_magic == detail::segment_header::magic &&
+               "FATAL (sparent) : not a cow_segment");
+        return result;
+    }
+
+    /*!
+        Returns the address the segment is mapped at in this process.
+    */
+    [[nodiscard]] auto base() const noexcept -> void* { return _base; }
+
+    /*!
+        Returns the size of the segment in bytes.
+    */
+    [[nodiscard]] auto size() const noexcept -> std::size_t {
+        return static_cast<std::size_t>(header()->_size);
+    }
+
+    /*!
+        Returns the number of bytes in free blocks.
+    */
+    [[nodiscard]] auto available() const noexcept -> std::size_t {
+        lock guard(header()->_locked);
+        std::size_t result = 0;
+        for (std::uint64_t n = header()->_free; n; n = block(n)->_next) result += block(n)->_size;
+        return static_cast<std::size_t>(result);
+    }
+
+    friend auto operator==(const cow_segment& x, const cow_segment& y) noexcept -> bool {
+        return x._base == y._base;
+    }
+
+    friend auto operator!=(const cow_segment& x, const cow_segment& y) noexcept -> bool {
+        return !(x == y);
+    }
+
+private:
+    /*
+        Returns the offset of `n` bytes aligned to `alignment`, preceded by a block header, or zero
+        if no free block is large enough.
+    */
+    auto allocate(std::size_t n) noexcept -> std::uint64_t {
+        const std::uint64_t size = (n + 2 * alignment - 1) / alignment * alignment;
+        lock guard(header()->_locked);
+        for (std::uint64_t* link = &header()->_free; *link; link = &block(*link)->_next) {
+            detail::segment_block* b = block(*link);
+            if (b->_size < size) continue;
+
+            const std::uint64_t offset = *link;
+            if (b->_size - size >= 2 * alignment) {
+                ::new (_base + offset + size) detail::segment_block{b->_size - size, b->_next};
+                *link = offset + size;
+                b->_size = size;
+            } else {
+                *link = b->_next;
+            }
+            return offset + alignment;
+        }
+        return 0;
+    }
+
+    /*
+        Returns the block allocated at `offset` to the free list, merging it with adjacent free
+        blocks.
+    */
+    void deallocate(std::uint64_t offset) noexcept {
+        const std::uint64_t start = offset - alignment;
+        lock guard(header()->_locked);
+        detail::segment_block* b = block(start);
+
+        std::uint64_t* link = &header()->_free;
+        detail::segment_block* previous = nullptr;
+        while (*link && *link < start) {
+            previous = block(*link);
+            link = &previous->_next;
+        }
+
+        b->_next = *link;
+        *link = start;
+        if (b->_next && start + b->_size == b->_next) {
+            b->_size += block(b->_next)->_size;
+            b->_next = block(b->_next)->_next;
+        }
+        if (previous && reinterpret_cast<unsigned char*>(previous) + previous->_size ==
+                            reinterpret_cast<unsigned char*>(b)) {
+            previous->_size += b->_size;
+            previous->_next = b->_next;
+        }
+    }
+};
+
+/**************************************************************************************************/
+
+/*!
+    A copy-on-write wrapper for a trivially copyable `T` whose value may live in a cow_segment, so
+    that several processes mapping the segment share a single physical copy of the value.
+
+    A value constructed in a segment holds an atomic reference count in the segment, shared by
+    the objects of every process referring to it. The offset() of the value identifies it to
+    another process, which calls attach() to refer to it. write() on a value in a segment detaches
+    it into memory local to the calling process, as a copy_on_write, so a segment is never written
+    by a process other than to count references and allocate values.
+
+    `T` must be trivially copyable, as its value is shared between processes that may map the
+    segment at different addresses, and so must not contain pointers.
+
+    If a process exits without destroying its objects, their references are never released and
+    the values remain in the segment until it is recreated.
+*/
+template <class T>
+class interprocess_copy_on_write {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "interprocess_copy_on_write requires a trivially copyable type");
+    static_assert(alignof(T) <= cow_segment::alignment,
+                  "interprocess_copy_on_write does not support this alignment");
+
+    struct shared_model {
+        std::atomic<std::size_t> _count{1};
+        alignas(T) T _value;
+
+        template <class... Args>
+        explicit shared_model(Args&&... args) : _value(std::forward<Args>(args)...) {}
+    };
+
+    cow_segment _segment;
+    shared_model* _shared{nullptr};
+    copy_on_write<T> _local;
+
+    auto offset_of(const shared_model* p) const noexcept -> std::uint64_t {
+        return static_cast<std::uint64_t>(reinterpret_cast<const unsigned char*>(p) -
+                                          _segment._base);
+    }
+
+    void release() noexcept {
+#if STLAB_COPY_ON_WRITE_TSAN
+        if (_shared && _shared->_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#else
+        if (_shared && _shared->_count.fetch_sub(1, std::memory_order_release) == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+            const std::uint64_t offset = offset_of(_shared);
+            std::destroy_at(_shared);
+            _segment.deallocate(offset);
+        }
+        _shared = nullptr;
+    }
+
+public:
+    /*!
+        The type of value stored.
+    */
+    using element_type = T;
+
+    /*!
+        The type identifying a value in a segment to another process.
+    */
+    using offset_type = std::uint64_t;
+
+    /*!
+        Default constructs the value in local memory.
+    */
+    interprocess_copy_on_write() = default;
+
+    /*!
+        Constructs the value in local memory, as copy_on_write<T>.
+    */
+    explicit interprocess_copy_on_write(copy_on_write<T> x) noexcept : _local(std::move(x)) {}
+
+    /*!
+        Constructs the value in `segment` by forwarding `args` to its constructor. If the
+        constructor throws, the value's block is returned to the segment.
+
+        @throw std::bad_alloc if the segment has no room for the value.
+    */
+    template <class... Args>
+    explicit interprocess_copy_on_write(cow_segment segment, std::in_place_t, Args&&... args) :
+        _segment(segment) {
+        const std::uint64_t offset = _segment.allocate(sizeof(shared_model));
+        if (!offset) throw std::bad_alloc();
+        try {
+            _shared = ::new (_segment._base + offset) shared_model(std::forward<Args>(args)...);
+        } catch (...) {
+            _segment.deallocate(offset);
+            throw;
+        }
+    }
+
+    /*!
+        Returns an object referring to the value at `offset` in `segment`, which another object,
+        in any process, must keep alive until this returns.
+    */
+    [[nodiscard]] static auto attach(cow_segment segment, offset_type offset) noexcept
+        -> interprocess_copy_on_write {
+        interprocess_copy_on_write result;
+        result._segment = segment;
+        result._shared = std::launder(reinterpret_cast<shared_model*>(segment._base + offset));
+        result._shared->_count.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    interprocess_copy_on_write(const interprocess_copy_on_write& x) noexcept :
+        _segment(x._segment), _shared(x._shared), _local(x._local) {
+        if (_shared) _shared->_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    interprocess_copy_on_write(interprocess_copy_on_write&& x) noexcept :
+        _segment(x._segment), _shared(std::exchange(x._shared, nullptr)),
+        _local(std::move(x._local)) {}
+
+    ~interprocess_copy_on_write() { release(); }
+
+    auto operator=(const interprocess_copy_on_write& x) noexcept -> interprocess_copy_on_write& {
+        return *this = interprocess_copy_on_write(x);
+    }
+
+    auto operator=(interprocess_copy_on_write&& x) noexcept -> interprocess_copy_on_write& {
+        auto tmp{std::move(x)};
+        swap(*this, tmp);
+        return *this;
+    }
+
+    /*!
+        Returns a const reference to the underlying value for read-only access.
+    */
+    [[nodiscard]] auto read() const noexcept -> const T& {
+        return _shared ? _shared->_value : _local.read();
+    }
+
+    /*!
+        Dereference operator that returns a const reference to the underlying value.
+    */
+    auto operator*() const noexcept -> const T& { return read(); }
+
+    /*!
+        Arrow operator that returns a const pointer to the underlying value.
+    */
+    auto operator->() const noexcept -> const T* { return &read(); }
+
+    /*!
+        Obtains a non-const reference to the underlying value. A value in a segment is copied
+        into local memory, and its reference in the segment released, so the segment is never
+        written. A local value is written as copy_on_write::write().
+    */
+    auto write() -> T& {
+        if (_shared) {
+            _local = copy_on_write<T>(_shared->_value);
+            release();
+        }
+        return _local.write();
+    }
+
+    /*!
+        Returns true if the value is in a segment.
+    */
+    [[nodiscard]] auto in_segment() const noexcept -> bool { return _shared; }
+
+    /*!
+        Returns the segment holding the value, if in_segment().
+    */
+    [[nodiscard]] auto segment() const noexcept -> cow_segment { return _segment; }
+
+    /*!
+        Returns the offset identifying the value in its segment to attach(). The value must be
+        in_segment().
+    */
+    [[nodiscard]] auto offset() const noexcept -> offset_type {
+        assert(_shared && "FATAL (sparent) : interprocess_copy_on_write is not in a segment");
+
+        return offset_of(_shared);
+    }
+
+    /*!
+        Returns true if this is the only reference, in any process, to the underlying value.
+    */
+    [[nodiscard]] auto unique() const noexcept -> bool {
+        return _shared ? _shared->_count.load(std::memory_order_acquire) == 1 : _local.unique();
+    }
+
+    /*!
+        Returns true if this object and `x` share the same underlying value.
+    */
+    [[nodiscard]] auto identity(const interprocess_copy_on_write& x) const noexcept -> bool {
+        return _shared ? _shared == x._shared : !x._shared && _local.identity(x._local);
+    }
+
+    friend inline void swap(interprocess_copy_on_write& x, interprocess_copy_on_write& y) noexcept {
+        std::swap(x._segment, y._segment);
+        std::swap(x._shared, y._shared);
+        swap(x._local, y._local);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,252 @@
+/*
+    Copyright 2025 Adobe
+    Distributed under the Boost Software License, Version 1.0.
+    (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+*/
+/**************************************************************************************************/
+
+/*!
+    @file lazy_copy_on_write.hpp
+    @brief A copy-on-write value constructed on first access
+
+    This file contains the implementation of stlab::lazy_copy_on_write, a copy_on_write whose
+    value is built by a factory the first time it is read or written.
+*/
+
+#ifndef STLAB_LAZY_COPY_ON_WRITE_HPP
+#define STLAB_LAZY_COPY_ON_WRITE_HPP
+
+/**************************************************************************************************/
+
+#include <stlab/copy_on_write.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+/**************************************************************************************************/
+
+namespace stlab {
+
+/**************************************************************************************************/
+
+/*!
+    A copy_on_write<T, Policies...> whose value may be pending: built by a factory the first time
+    any object sharing it is read or written, rather than when the object is constructed. Copies
+    of a pending object share the factory, so the value is built once, by whichever thread first
+    accesses it, and then shared by all of them.
+
+    A pending object costs one allocation, holding the factory, and no construction of `T`, so
+    members of a document that are never accessed cost little to load. Once the value is built,
+    read() checks a flag before reading it, and write() detaches the object from the factory,
+    after which it behaves as a copy_on_write.
+
+    If the factory throws, the exception propagates from the access and the value is built by the
+    next access.
+*/
+template <class T, class... Policies>
+class lazy_copy_on_write {
+public:
+    /*!
+        The type of the built value.
+    */
+    using value_type = copy_on_write<T, Policies...>;
+
+    /*!
+        The type of value stored.
+    */
+    using element_type = T;
+
+private:
+    /*
+        The factory and, once built, the value shared by the copies of a pending object.
+    */
+    class pending {
+        std::mutex _mutex;
+        std::atomic<bool> _ready{false};
+        std::optional<value_type> _value;
+
+        virtual auto make() -> value_type = 0;
+
+    public:
+        virtual ~pending() = default;
+
+        auto get() -> value_type& {
+            // std::call_once is not used as some implementations deadlock if the factory throws.
+            if (!_ready.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_ready.load(std::memory_order_relaxed)) {
+                    _value.emplace(make());
+                    _ready.store(true, std::memory_order_release);
+                }
+            }
+            return *_value;
+        }
+
+        [[nodiscard]] auto ready() const noexcept -> const value_type* {
+            return _ready.load(std::memory_order_acquire) ? &*_value : nullptr;
+        }
+    };
+
+    template <class F>
+    class pending_factory final : public pending {
+        std::optional<F> _factory;
+
+        auto make() -> value_type override {
+            value_type result(std::invoke(*_factory));
+            _factory.reset();
+            return result;
+        }
+
+    public:
+        explicit pending_factory(F f) : _factory(std::move(f)) {}
+    };
+
+    /*
+        Either the object is pending or it holds its value, so a pending object never constructs
+        a copy_on_write, and `T` need not be default constructible.
+    */
+    std::shared_ptr<pending> _pending;
+    std::optional<value_type> _value;
+
+    struct adopt_t {};
+    static constexpr adopt_t adopt{};
+
+    lazy_copy_on_write(adopt_t, std::shared_ptr<pending> p) noexcept : _pending(std::move(p)) {}
+
+    /*
+        The value, if it has been built, otherwise nullptr.
+    */
+    [[nodiscard]] auto current() const noexcept -> const value_type* {
+        return _pending ? _pending->ready() : &*_value;
+    }
+
+    [[nodiscard]] auto value() const noexcept -> const value_type& {
+        assert(_value && "FATAL (sparent) : using a moved lazy_copy_on_write object");
+        return *_value;
+    }
+
+public:
+    /*!
+        Default constructs the value, as copy_on_write. The object is not pending.
+    */
+    lazy_copy_on_write() : _value(std::in_place) {}
+
+    /*!
+        Constructs an object holding `x`, which is not pending.
+    */
+    lazy_copy_on_write(value_type x) noexcept : _value(std::move(x)) {}
+
+    /*!
+        Returns a pending object whose value is built by calling `factory` with no arguments the
+        first time it, or a copy of it, is accessed.
+    */
+    template <class F>
+    [[nodiscard]] static auto lazy(F factory) -> lazy_copy_on_write {
+        static_assert(std::is_invocable_r_v<T, F&>, "F must be invocable and return T");
+
+        return lazy_copy_on_write(adopt, std::make_shared<pending_factory<F>>(std::move(factory)));
+    }
+
+    /*!
+        Returns a const reference to the underlying value for read-only access, building it if
+        the object is pending and no copy has accessed it.
+    */
+    [[nodiscard]] auto read() const -> const T& {
+        return _pending ? _pending->get().read() : value().read();
+    }
+
+    /*!
+        Dereference operator that returns a const reference to the underlying value.
+    */
+    auto operator*() const -> const T& { return read(); }
+
+    /*!
+        Arrow operator that returns a const pointer to the underlying value.
+    */
+    auto operator->() const -> const T* { return &read(); }
+
+    /*!
+        Obtains a non-const reference to the underlying value, building it if it is pending, and
+        detaching the object from its factory. The value is copied as copy_on_write::write() if it
+        is shared with other objects.
+    */
+    auto write() -> T& {
+        if (_pending) {
+            if (_pending.use_count() == 1) {
+                _value.emplace(std::move(_pending->get()));
+            } else {
+                _value.emplace(_pending->get());
+            }
+            _pending.reset();
+        }
+        assert(_value && "FATAL (sparent) : using a moved lazy_copy_on_write object");
+        return _value->write();
+    }
+
+    /*!
+        Returns the value, building it if the object is pending.
+    */
+    [[nodiscard]] auto get() const -> const value_type& {
+        return _pending ? _pending->get() : value();
+    }
+
+    /*!
+        Returns true if the value has been built, so accessing it will not call the factory.
+    */
+    [[nodiscard]] auto materialized() const noexcept -> bool { return current(); }
+
+    /*!
+        Returns true if this is the only reference to the underlying value, or to the factory of
+        a pending object, so write() will not copy the value.
+    */
+    [[nodiscard]] auto unique() const noexcept -> bool {
+        if (!_pending) return value().unique();
+        const value_type* value = _pending->ready();
+        return _pending.use_count() == 1 && (!value || value->unique());
+    }
+
+    /*!
+        Returns true if this object and `x` share the same underlying value, or the same factory.
+        Neither value is built.
+    */
+    [[nodiscard]] auto identity(const lazy_copy_on_write& x) const noexcept -> bool {
+        if (_pending && _pending == x._pending) return true;
+        const value_type* p = current();
+        const value_type* q = x.current();
+        return p && q && p->identity(*q);
+    }
+
+    friend inline void swap(lazy_copy_on_write& x, lazy_copy_on_write& y) noexcept {
+        swap(x._pending, y._pending);
+        swap(x._value, y._value);
+    }
+
+    /*!
+        Compares the values, building them if they are pending.
+    */
+    friend inline auto operator==(const lazy_copy_on_write& x, const lazy_copy_on_write& y)
+        -> bool {
+        return x.identity(y) || x.get() == y.get();
+    }
+
+    friend inline auto operator!=(const lazy_copy_on_write& x, const lazy_copy_on_write& y)
+        -> bool {
+        return !(x == y);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace stlab
+
+/**************************************************************************************************/
+
+#endif
+
+/**************************************************************************************************/
@@ -0,0 +1,200 @@
+#include <stlab/atomic_copy_on_write.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using stlab::atomic_copy_on_write;
+using stlab::copy_on_write;
+
+namespace {
+
+struct live_observer : stlab::copy_on_write_observer {
+    static inline std::atomic<int> live{0};
+
+    static void on_construct(std::size_t) noexcept { ++live; }
+    static void on_detach(std::size_t) noexcept { ++live; }
+    static void on_destroy(std::size_t) noexcept { --live; }
+};
+
+using counted = copy_on_write<int, stlab::instrumented<live_observer>>;
+
+} // namespace
+
+TEST_CASE("atomic_copy_on_write operations") {
+    static_assert(atomic_copy_on_write<std::string>::is_always_lock_free);
+
+    atomic_copy_on_write<std::string> a(std::string("hello"));
+
+    SUBCASE("load shares the stored value") {
+        copy_on_write<std::string> x = a.load();
+        copy_on_write<std::string> y = a.load();
+        CHECK(*x == "hello");
+        CHECK(x.identity(y));
+    }
+
+    SUBCASE("default construction stores a default constructed value") {
+        atomic_copy_on_write<std::string> b;
+        CHECK(b.load().identity(copy_on_write<std::string>()));
+    }
+
+    SUBCASE("store and exchange") {
+        copy_on_write<std::string> x(std::string("world"));
+        a.store(x);
+        CHECK(a.load().identity(x));
+
+        copy_on_write<std::string> old = a.exchange(copy_on_write<std::string>("again"));
+        CHECK(old.identity(x));
+        CHECK(*a.load() == "again");
+
+        a = x;
+        CHECK(a.load().identity(x));
+    }
+
+    SUBCASE("compare_exchange compares identity") {
+        copy_on_write<std::string> expected(std::string("hello"));
+        copy_on_write<std::string> desired(std::string("world"));
+
+        CHECK_FALSE(a.compare_exchange_strong(expected, desired));
+        CHECK(*expected == "hello");
+        CHECK(expected.identity(a.load()));
+
+        CHECK(a.compare_exchange_strong(expected, desired));
+        CHECK(a.load().identity(desired));
+
+        while (!a.compare_exchange_weak(desired, expected)) {}
+        CHECK(a.load().identity(expected));
+    }
+}
+
+TEST_CASE("atomic_copy_on_write reclamation") {
+    {
+        atomic_copy_on_write<int, stlab::instrumented<live_observer>> a(counted(0));
+        for (int n = 1; n != 1000; ++n) a.store(counted(n));
+        CHECK(*a.load() == 999);
+        CHECK(live_observer::live < 200);
+    }
+
+    SUBCASE("replaced values are released when the storing thread exits") {
+        const int live = live_observer::live;
+        atomic_copy_on_write<int, stlab::instrumented<live_observer>> a(counted(0));
+        std::thread([&] {
+            for (int n = 1; n != 10; ++n) a.store(counted(n));
+        }).join();
+        CHECK(live_observer::live == live + 1);
+    }
+
+    SUBCASE("a borrowed value is released after the atomic_copy_on_write and the view") {
+        using atomic_counted = atomic_copy_on_write<int, stlab::instrumented<live_observer>>;
+        const int live = live_observer::live;
+        {
+            auto a = std::make_unique<atomic_counted>(counted(1));
+            auto borrowed = a->borrow();
+            a.reset();
+            CHECK(*borrowed == 1);
+            CHECK(live_observer::live == live + 1);
+        }
+        std::thread([] { atomic_counted(counted(2)).store(counted(3)); }).join();
+        CHECK(live_observer::live == live);
+    }
+}
+
+TEST_CASE("atomic_copy_on_write concurrent publish") {
+    atomic_copy_on_write<std::vector<int>> a(std::vector<int>(64, 0));
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> readers;
+    std::atomic<int> torn{0};
+    for (int n = 0; n != 4; ++n) {
+        readers.emplace_back([&] {
+            while (!done.load(std::memory_order_relaxed)) {
+                copy_on_write<std::vector<int>> snapshot = a.load();
+                for (int e : *snapshot) {
+                    if (e != snapshot->front()) ++torn;
+                }
+            }
+        });
+    }
+
+    for (int n = 1; n != 2000; ++n) {
+        a.store(copy_on_write<std::vector<int>>(std::vector<int>(64, n)));
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+
+    CHECK(torn == 0);
+    CHECK(a.load()->front() == 1999);
+}
+
+TEST_CASE("atomic_copy_on_write borrow") {
+    using shared = copy_on_write<std::string, stlab::weak_references>;
+
+    shared x(std::string("hello"));
+    atomic_copy_on_write<std::string, stlab::weak_references> a(x);
+    shared::weak_type w(x);
+
+    SUBCASE("borrowing does not modify the reference count") {
+        REQUIRE(w.use_count() == 2);
+        auto borrowed = a.borrow();
+        CHECK(*borrowed == "hello");
+        CHECK(borrowed->size() == 5);
+        CHECK(borrowed.identity(x));
+        CHECK(w.use_count() == 2);
+
+        shared y = borrowed.copy();
+        CHECK(y.identity(x));
+        CHECK(w.use_count() == 3);
+    }
+
+    SUBCASE("a borrowed value outlives being replaced") {
+        x = shared();
+        auto borrowed = a.borrow();
+        for (int n = 0; n != 1000; ++n) a.store(shared(std::to_string(n)));
+
+        CHECK_FALSE(w.expired());
+        CHECK(borrowed.read() == "hello");
+        CHECK(*a.load() == "999");
+    }
+
+    SUBCASE("a borrowed value outlives the atomic_copy_on_write") {
+        x = shared();
+        auto b = std::make_unique<atomic_copy_on_write<std::string, stlab::weak_references>>(
+            shared(std::string("borrowed")));
+        auto borrowed = b->borrow();
+        b.reset();
+
+        CHECK(borrowed.read() == "borrowed");
+        CHECK(borrowed->size() == 8);
+    }
+
+    SUBCASE("concurrent readers borrow while a writer stores") {
+        a.store(shared(std::string(64, 'a')));
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0};
+        std::vector<std::thread> readers;
+        for (int n = 0; n != 4; ++n) {
+            readers.emplace_back([&] {
+                while (!done.load(std::memory_order_relaxed)) {
+                    auto borrowed = a.borrow();
+                    if (borrowed->empty() || borrowed->find_first_not_of(borrowed->front()) !=
+                                                 std::string::npos) {
+                        ++torn;
+                    }
+                }
+            });
+        }
+        for (int n = 0; n != 2000; ++n) {
+            a.store(shared(std::string(64, static_cast<char>('a' + n % 26))));
+        }
+        done = true;
+        for (auto& reader : readers) reader.join();
+
+        CHECK(torn == 0);
+    }
+}
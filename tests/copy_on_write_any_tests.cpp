@@ -0,0 +1,110 @@
+#include <stlab/copy_on_write_any.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using stlab::copy_on_write_any;
+
+namespace {
+
+struct command {
+    virtual ~command() = default;
+    virtual auto name() const -> std::string = 0;
+
+protected:
+    command() = default;
+    command(const command&) = default;
+    auto operator=(const command&) -> command& = default;
+};
+
+struct insert_text : command {
+    std::string _text;
+
+    explicit insert_text(std::string text) : _text(std::move(text)) {}
+    auto name() const -> std::string override { return "insert " + _text; }
+
+    friend auto operator==(const insert_text& x, const insert_text& y) -> bool {
+        return x._text == y._text;
+    }
+};
+
+struct delete_range : command {
+    int _first;
+    int _last;
+
+    delete_range(int first, int last) : _first(first), _last(last) {}
+    auto name() const -> std::string override { return "delete"; }
+
+    friend auto operator==(const delete_range& x, const delete_range& y) -> bool {
+        return x._first == y._first && x._last == y._last;
+    }
+};
+
+} // namespace
+
+TEST_CASE("copy_on_write_any construction and access") {
+    copy_on_write_any<command> a(insert_text("hello"));
+    copy_on_write_any<command> b(std::in_place_type<delete_range>, 1, 4);
+
+    CHECK(a->name() == "insert hello");
+    CHECK((*b).name() == "delete");
+    CHECK(a.unique());
+
+    REQUIRE(a.target<insert_text>());
+    CHECK(a.target<insert_text>()->_text == "hello");
+    CHECK_FALSE(a.target<delete_range>());
+    CHECK(b.target<delete_range>()->_last == 4);
+}
+
+TEST_CASE("copy_on_write_any copy semantics") {
+    copy_on_write_any<command> a(insert_text("hello"));
+    copy_on_write_any<command> b(a);
+
+    CHECK(a.identity(b));
+    CHECK_FALSE(a.unique());
+    CHECK(&a.read() == &b.read());
+
+    SUBCASE("write copies the concrete type") {
+        static_cast<insert_text&>(b.write())._text = "world";
+        CHECK_FALSE(a.identity(b));
+        CHECK(a.unique());
+        CHECK(b.unique());
+        CHECK(a->name() == "insert hello");
+        CHECK(b->name() == "insert world");
+        CHECK(b.target<insert_text>());
+    }
+
+    SUBCASE("unique writes are in place") {
+        b = copy_on_write_any<command>(delete_range(0, 1));
+        const command* before = &a.read();
+        CHECK(&a.write() == before);
+    }
+
+    SUBCASE("move") {
+        copy_on_write_any<command> c(std::move(b));
+        CHECK(c.identity(a));
+        b = std::move(c);
+        CHECK(b.identity(a));
+    }
+}
+
+TEST_CASE("copy_on_write_any comparison") {
+    copy_on_write_any<command> a(insert_text("x"));
+    copy_on_write_any<command> b(insert_text("x"));
+    copy_on_write_any<command> c(insert_text("y"));
+    copy_on_write_any<command> d(delete_range(0, 1));
+
+    CHECK(a == a);
+    CHECK(a == b);
+    CHECK(a != c);
+    CHECK(a != d);
+
+    std::vector<copy_on_write_any<command>> undo{a, c, d};
+    std::vector<copy_on_write_any<command>> snapshot(undo);
+    CHECK(snapshot == undo);
+    CHECK(snapshot[2].identity(undo[2]));
+}
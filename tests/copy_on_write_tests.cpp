@@ -3,12 +3,122 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 using stlab::copy_on_write;
 
+namespace {
+
+// Counts the blocks allocated through every arena_allocator that refers to it.
+struct arena {
+    std::size_t allocations = 0;
+    std::size_t deallocations = 0;
+};
+
+template <class T>
+struct arena_allocator {
+    using value_type = T;
+
+    arena* _arena;
+
+    explicit arena_allocator(arena& a) noexcept : _arena(&a) {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& x) noexcept : _arena(x._arena) {}
+
+    auto allocate(std::size_t n) -> T* {
+        ++_arena->allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        ++_arena->deallocations;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    friend auto operator==(const arena_allocator& x, const arena_allocator& y) -> bool {
+        return x._arena == y._arena;
+    }
+
+    friend auto operator!=(const arena_allocator& x, const arena_allocator& y) -> bool {
+        return !(x == y);
+    }
+};
+
+struct observed_events {
+    std::size_t construct = 0;
+    std::size_t share = 0;
+    std::size_t detach = 0;
+    std::size_t write_inplace = 0;
+    std::size_t assign_inplace = 0;
+    std::size_t destroy = 0;
+    std::size_t bytes_copied = 0;
+};
+
+// Records every copy_on_write event in static counters.
+struct fragile {
+    int value = 0;
+    static inline std::atomic<int> copies_until_throw{0};
+
+    fragile() = default;
+    explicit fragile(int v) : value(v) {}
+    fragile(const fragile& x) : value(x.value) {
+        if (--copies_until_throw == 0) throw std::runtime_error("copy failed");
+    }
+    auto operator=(const fragile&) -> fragile& = default;
+};
+
+// Counts the live instances.
+struct counted {
+    static inline std::atomic<int> live{0};
+
+    counted() { ++live; }
+    counted(const counted&) { ++live; }
+    auto operator=(const counted&) -> counted& = default;
+    ~counted() { --live; }
+};
+
+// A hash of strings that counts its calls.
+struct counting_hash {
+    static inline int calls = 0;
+
+    auto operator()(const std::string& x) const -> std::size_t {
+        ++calls;
+        return std::hash<std::string>()(x);
+    }
+};
+
+struct recording_observer : stlab::copy_on_write_observer {
+    static inline observed_events events;
+
+    static auto size(const std::string& value) noexcept -> std::size_t { return value.size(); }
+
+    static void on_construct(std::size_t) noexcept { ++events.construct; }
+    static void on_share() noexcept { ++events.share; }
+    static void on_detach(std::size_t bytes) noexcept {
+        ++events.detach;
+        events.bytes_copied += bytes;
+    }
+    static void on_write_inplace() noexcept { ++events.write_inplace; }
+    static void on_assign_inplace() noexcept { ++events.assign_inplace; }
+    static void on_destroy(std::size_t) noexcept { ++events.destroy; }
+};
+
+} // namespace
+
 TEST_CASE("copy_on_write basic construction") {
     SUBCASE("default construction") {
         copy_on_write<int> cow;
@@ -18,6 +128,20 @@ TEST_CASE("copy_on_write basic construction") {
         CHECK(cow.identity(cow2));
     }
 
+    SUBCASE("default construction is never unique") {
+        copy_on_write<std::string> cow;
+        CHECK_FALSE(cow.unique());
+        {
+            copy_on_write<std::string> copy(cow);
+            CHECK(copy.identity(cow));
+        }
+        CHECK_FALSE(cow.unique()); // destroying a copy does not make the shared value unique
+
+        cow.write() = "hello";
+        CHECK(cow.unique());
+        CHECK(*copy_on_write<std::string>() == "");
+    }
+
     SUBCASE("value construction") {
         copy_on_write<int> cow(42);
         CHECK(*cow == 42);
@@ -258,3 +382,902 @@ TEST_CASE("copy_on_write with complex types") {
     CHECK(cow2->value == 42);
     CHECK_FALSE(cow.identity(cow2));
 }
+
+TEST_CASE("copy_on_write with allocator") {
+    arena a;
+
+    SUBCASE("allocate_copy_on_write allocates from the allocator") {
+        {
+            auto cow = stlab::allocate_copy_on_write<std::string>(arena_allocator<int>(a), "hello");
+            CHECK(*cow == "hello");
+            CHECK(cow.unique());
+            CHECK(cow.get_allocator() == arena_allocator<std::string>(a));
+            CHECK(a.allocations == 1);
+        }
+        CHECK(a.deallocations == 1);
+    }
+
+    SUBCASE("copies share the allocation") {
+        {
+            copy_on_write<int, arena_allocator<int>> cow1(std::allocator_arg,
+                                                          arena_allocator<int>(a), 42);
+            copy_on_write<int, arena_allocator<int>> cow2(cow1);
+            CHECK(cow1.identity(cow2));
+            CHECK(a.allocations == 1);
+        }
+        CHECK(a.deallocations == 1);
+    }
+
+    SUBCASE("write copies with the same allocator") {
+        {
+            copy_on_write<int, arena_allocator<int>> cow1(std::allocator_arg,
+                                                          arena_allocator<int>(a), 42);
+            copy_on_write<int, arena_allocator<int>> cow2(cow1);
+
+            cow2.write() = 100;
+
+            CHECK(*cow1 == 42);
+            CHECK(*cow2 == 100);
+            CHECK(cow2.get_allocator() == cow1.get_allocator());
+            CHECK(a.allocations == 2);
+        }
+        CHECK(a.deallocations == 2);
+    }
+
+    SUBCASE("assignment when shared copies with the same allocator") {
+        {
+            copy_on_write<std::string, arena_allocator<std::string>> cow1(
+                std::allocator_arg, arena_allocator<std::string>(a), "hello");
+            auto cow2 = cow1;
+
+            cow2 = std::string("world");
+
+            CHECK(*cow1 == "hello");
+            CHECK(*cow2 == "world");
+            CHECK(a.allocations == 2);
+        }
+        CHECK(a.deallocations == 2);
+    }
+
+    SUBCASE("allocator construction value initializes") {
+        copy_on_write<int, arena_allocator<int>> cow(std::allocator_arg, arena_allocator<int>(a));
+        CHECK(*cow == 0);
+        CHECK(cow.unique());
+        CHECK(a.allocations == 1);
+    }
+}
+
+TEST_CASE("copy_on_write single_threaded") {
+    using stlab::single_threaded;
+
+    SUBCASE("copy and write") {
+        copy_on_write<std::string, single_threaded> cow1(std::string("hello"));
+        copy_on_write<std::string, single_threaded> cow2(cow1);
+
+        CHECK(cow1.identity(cow2));
+        CHECK_FALSE(cow1.unique());
+
+        cow2.write() = "world";
+
+        CHECK(*cow1 == "hello");
+        CHECK(*cow2 == "world");
+        CHECK(cow1.unique());
+        CHECK(cow2.unique());
+    }
+
+    SUBCASE("default construction") {
+        copy_on_write<int, single_threaded> cow1;
+        copy_on_write<int, single_threaded> cow2;
+        CHECK(*cow1 == 0);
+        CHECK(cow1.identity(cow2));
+    }
+
+    SUBCASE("policies in any order") {
+        arena a;
+        {
+            copy_on_write<int, single_threaded, arena_allocator<int>> cow1(
+                std::allocator_arg, arena_allocator<int>(a), 42);
+            auto cow2 =
+                stlab::allocate_copy_on_write<int, single_threaded>(arena_allocator<int>(a), 42);
+
+            using expected = copy_on_write<int, arena_allocator<int>, single_threaded>;
+            static_assert(std::is_same_v<decltype(cow2), expected>);
+            CHECK(*cow1 == *cow2);
+            CHECK(a.allocations == 2);
+        }
+        CHECK(a.deallocations == 2);
+    }
+}
+
+TEST_CASE("copy_on_write layout") {
+    struct alignas(64) tile {
+        float data[16] = {};
+
+        bool operator==(const tile& other) const { return data[0] == other.data[0]; }
+        bool operator<(const tile& other) const { return data[0] < other.data[0]; }
+    };
+
+    auto aligned = [](const void* p, std::size_t alignment) {
+        return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+    };
+
+    SUBCASE("over-aligned value") {
+        copy_on_write<tile> cow1{tile{}};
+        copy_on_write<tile> cow2(cow1);
+        cow2.write().data[0] = 1;
+
+        CHECK(aligned(&*cow1, 64));
+        CHECK(aligned(&*cow2, 64));
+        CHECK(*cow1 < *cow2);
+    }
+
+    SUBCASE("padded count") {
+        copy_on_write<int, stlab::padded_count<>> cow1(42);
+        copy_on_write<int, stlab::padded_count<>> cow2(cow1);
+
+        CHECK(aligned(&*cow1, 64));
+        CHECK(cow1.identity(cow2));
+
+        cow2.write() = 100;
+        CHECK(aligned(&*cow2, 64));
+        CHECK(*cow1 == 42);
+        CHECK(*cow2 == 100);
+
+        copy_on_write<int, stlab::padded_count<>> cow3;
+        CHECK(aligned(&*cow3, 64));
+    }
+}
+
+TEST_CASE("copy_on_write array") {
+    SUBCASE("default construction is empty") {
+        copy_on_write<int[]> cow1;
+        copy_on_write<int[]> cow2;
+        CHECK(cow1.empty());
+        CHECK(cow1.size() == 0);
+        CHECK(cow1.begin() == cow1.end());
+        CHECK(cow1.identity(cow2));
+        CHECK_FALSE(cow1.unique());
+    }
+
+    SUBCASE("sized construction") {
+        copy_on_write<int[]> cow1(std::size_t{3});
+        CHECK(cow1.size() == 3);
+        CHECK(cow1[0] == 0);
+        CHECK(cow1[2] == 0);
+        CHECK(cow1.unique());
+
+        copy_on_write<std::string[]> cow2(2, "hello");
+        CHECK(cow2.size() == 2);
+        CHECK(cow2[1] == "hello");
+    }
+
+    SUBCASE("range construction") {
+        std::vector<std::string> source{"a", "b", "c"};
+        copy_on_write<std::string[]> cow1(source.begin(), source.end());
+        copy_on_write<std::string[]> cow2{"a", "b", "c"};
+
+        CHECK(cow1.size() == 3);
+        CHECK(cow1[2] == "c");
+        CHECK(cow1 == cow2);
+        CHECK_FALSE(cow1.identity(cow2));
+    }
+
+    SUBCASE("write triggers copy") {
+        copy_on_write<std::string[]> cow1{"a", "b", "c"};
+        copy_on_write<std::string[]> cow2(cow1);
+
+        CHECK(cow1.identity(cow2));
+
+        cow2.write()[1] = "x";
+
+        CHECK(cow1[1] == "b");
+        CHECK(cow2[1] == "x");
+        CHECK(cow1.unique());
+        CHECK(cow2.unique());
+        CHECK(cow1 < cow2);
+        CHECK(cow1 != cow2);
+
+        const std::string* data = cow2.data();
+        cow2.write()[0] = "y"; // unique, so written in place
+        CHECK(cow2.data() == data);
+    }
+
+    SUBCASE("write on default constructed copies") {
+        copy_on_write<int[]> cow;
+        CHECK(cow.write() == cow.data());
+        CHECK(cow.unique());
+        CHECK(cow.empty());
+    }
+
+    SUBCASE("allocator") {
+        arena a;
+        {
+            copy_on_write<std::string[], arena_allocator<std::string>> cow1(
+                std::allocator_arg, arena_allocator<std::string>(a), {"a", "b"});
+            auto cow2 = cow1;
+            cow2.write()[0] = "b";
+
+            CHECK(cow1.get_allocator() == cow2.get_allocator());
+            CHECK(a.allocations == 2);
+        }
+        CHECK(a.deallocations == 2);
+    }
+
+    SUBCASE("aligned elements") {
+        struct alignas(64) tile {
+            float data[16] = {};
+
+            bool operator==(const tile& other) const { return data[0] == other.data[0]; }
+            bool operator<(const tile& other) const { return data[0] < other.data[0]; }
+        };
+
+        copy_on_write<tile[]> cow1(std::size_t{4});
+        copy_on_write<int[], stlab::padded_count<>> cow2(std::size_t{4});
+
+        CHECK(reinterpret_cast<std::uintptr_t>(cow1.data()) % 64 == 0);
+        CHECK(reinterpret_cast<std::uintptr_t>(cow2.data()) % 64 == 0);
+    }
+}
+
+TEST_CASE("copy_on_write instrumented") {
+    using instrumented_string =
+        copy_on_write<std::string, stlab::instrumented<recording_observer>>;
+    auto& events = recording_observer::events;
+    events = {};
+
+    {
+        instrumented_string cow1(std::string("hello"));
+        CHECK(events.construct == 1);
+
+        instrumented_string cow2(cow1);
+        CHECK(events.share == 1);
+
+        cow2.write() += " world";
+        CHECK(events.detach == 1);
+        CHECK(events.bytes_copied == 5);
+        CHECK(events.construct == 1); // a detach is not reported as a construction
+
+        cow2.write() += "!";
+        CHECK(events.write_inplace == 1);
+
+        cow1 = std::string("goodbye");
+        CHECK(events.assign_inplace == 1);
+
+        cow2 = cow1;
+        CHECK(events.share == 2);
+        CHECK(events.destroy == 1);
+
+        cow2 = std::string("hola");
+        CHECK(events.construct == 2);
+
+        cow2.write([](const std::string& value) { return value + "!"; },
+                   [](std::string& value) { value += "!"; });
+        CHECK(events.write_inplace == 2);
+    }
+    CHECK(events.destroy == 3);
+
+    SUBCASE("array") {
+        using instrumented_array = copy_on_write<int[], stlab::instrumented<recording_observer>>;
+        events = {};
+        {
+            instrumented_array cow1{1, 2, 3};
+            instrumented_array cow2(cow1);
+            cow2.write()[0] = 4;
+            cow2.write()[1] = 5;
+
+            CHECK(events.construct == 1);
+            CHECK(events.share == 1);
+            CHECK(events.detach == 1);
+            CHECK(events.bytes_copied == 3 * sizeof(int));
+            CHECK(events.write_inplace == 1);
+        }
+        CHECK(events.destroy == 2);
+    }
+}
+
+TEST_CASE("copy_on_write write_all") {
+    SUBCASE("writes every element") {
+        std::vector<copy_on_write<std::string>> values{std::string("a"), std::string("b")};
+        copy_on_write<std::string> shared(values[0]);
+        const std::string* unique_value = &values[1].read();
+
+        stlab::write_all(values, [](std::string& value) { value += "!"; });
+
+        CHECK(*values[0] == "a!");
+        CHECK(*values[1] == "b!");
+        CHECK(*shared == "a");
+        CHECK(values[0].unique());
+        CHECK(shared.unique());
+        CHECK(&values[1].read() == unique_value); // unique values are written in place
+    }
+
+    SUBCASE("elements sharing only with each other keep one value") {
+        copy_on_write<std::string> a(std::string("a"));
+        std::vector<copy_on_write<std::string>> values{a, a, a};
+        a = copy_on_write<std::string>(std::string("b"));
+        const std::string* original = &values[0].read();
+
+        stlab::write_all(values.begin(), values.end(), [](std::string& value) { value += "!"; });
+
+        for (const auto& e : values) {
+            CHECK(*e == "a!");
+            CHECK(e.unique());
+        }
+        CHECK(&values[2].read() == original);
+    }
+
+    SUBCASE("default constructed elements are copied") {
+        std::vector<copy_on_write<int>> values(3);
+
+        stlab::write_all(values, [](int& value) { ++value; });
+
+        for (const auto& e : values) {
+            CHECK(*e == 1);
+            CHECK(e.unique());
+        }
+        CHECK(*copy_on_write<int>() == 0);
+    }
+
+    SUBCASE("a throwing copy leaves every element unchanged") {
+        copy_on_write<fragile> a(fragile(1));
+        copy_on_write<fragile> b(fragile(2));
+        std::vector<copy_on_write<fragile>> values{a, b};
+        fragile::copies_until_throw = 2;
+
+        CHECK_THROWS_AS(stlab::write_all(values, [](fragile& x) { x.value = 0; }),
+                        std::runtime_error);
+
+        CHECK(values[0].identity(a));
+        CHECK(values[1].identity(b));
+        CHECK(a->value == 1);
+        CHECK(b->value == 2);
+    }
+}
+
+TEST_CASE("copy_on_write array parallel write") {
+    std::vector<std::thread> threads;
+    auto thread_executor = [&](auto task) { threads.emplace_back(std::move(task)); };
+    auto inline_executor = [](auto task) { task(); };
+
+    SUBCASE("copies every chunk") {
+        std::vector<int> source(1000);
+        for (std::size_t n = 0; n != source.size(); ++n) source[n] = static_cast<int>(n);
+        copy_on_write<int[]> cow1(source.begin(), source.end());
+        copy_on_write<int[]> cow2(cow1);
+
+        cow2.write(thread_executor, 64)[0] = -1;
+        for (auto& e : threads) e.join();
+
+        CHECK(threads.size() == 15);
+        CHECK(cow1[0] == 0);
+        CHECK(cow2[0] == -1);
+        CHECK(std::equal(cow1.begin() + 1, cow1.end(), cow2.begin() + 1));
+        CHECK(cow2.unique());
+    }
+
+    SUBCASE("unique arrays are written in place") {
+        copy_on_write<int[]> cow(std::size_t{100});
+        const int* original = cow.data();
+
+        CHECK(cow.write(thread_executor, 1) == original);
+        CHECK(threads.empty());
+    }
+
+    SUBCASE("a throwing copy leaves the array shared") {
+        copy_on_write<fragile[]> cow1(std::size_t{10});
+        copy_on_write<fragile[]> cow2(cow1);
+        fragile::copies_until_throw = 7;
+
+        CHECK_THROWS_AS(cow2.write(inline_executor, 3), std::runtime_error);
+        CHECK(cow1.identity(cow2));
+    }
+}
+
+TEST_CASE("copy_on_write prepare_write") {
+    std::vector<std::thread> threads;
+    auto thread_executor = [&](auto task) { threads.emplace_back(std::move(task)); };
+    auto inline_executor = [](auto task) { task(); };
+
+    SUBCASE("installs the prepared copy") {
+        copy_on_write<std::string> cow1(std::string("hello"));
+        copy_on_write<std::string> cow2(cow1);
+
+        auto prepared = cow2.prepare_write(thread_executor);
+        cow2.write(std::move(prepared)) += "!";
+        for (auto& e : threads) e.join();
+
+        CHECK(*cow1 == "hello");
+        CHECK(*cow2 == "hello!");
+        CHECK(cow1.unique());
+        CHECK(cow2.unique());
+    }
+
+    SUBCASE("writes in place if the object became unique") {
+        copy_on_write<std::string> cow1(std::string("hello"));
+        const std::string* original = &cow1.read();
+        auto prepared = [&] {
+            copy_on_write<std::string> cow2(cow1);
+            return cow1.prepare_write(inline_executor);
+        }();
+
+        cow1.write(std::move(prepared)) += "!";
+
+        CHECK(&cow1.read() == original);
+        CHECK(*cow1 == "hello!");
+        CHECK(cow1.unique());
+    }
+
+    SUBCASE("falls back to write if the object changed") {
+        copy_on_write<std::string> cow1(std::string("hello"));
+        copy_on_write<std::string> cow2(cow1);
+
+        auto prepared = cow2.prepare_write(inline_executor);
+        cow2 = std::string("world");
+        cow2.write(std::move(prepared)) += "!";
+
+        CHECK(*cow1 == "hello");
+        CHECK(*cow2 == "world!");
+    }
+
+    SUBCASE("unique objects are not copied") {
+        copy_on_write<std::string> cow(std::string("hello"));
+        const std::string* original = &cow.read();
+
+        auto prepared = cow.prepare_write(thread_executor);
+        CHECK(threads.empty());
+        CHECK(cow.unique());
+        CHECK(&cow.write(std::move(prepared)) == original);
+    }
+
+    SUBCASE("a throwing copy is rethrown by write") {
+        copy_on_write<fragile> cow1(fragile(1));
+        copy_on_write<fragile> cow2(cow1);
+        fragile::copies_until_throw = 1;
+
+        auto prepared = cow2.prepare_write(inline_executor);
+        CHECK_THROWS_AS(cow2.write(std::move(prepared)), std::runtime_error);
+        CHECK(cow1.identity(cow2));
+    }
+}
+
+TEST_CASE("copy_on_write extract") {
+    SUBCASE("moves the value out of a unique object") {
+        copy_on_write<std::vector<int>> cow(std::vector<int>(100, 1));
+        const int* data = cow->data();
+
+        std::vector<int> value = std::move(cow).extract();
+
+        CHECK(value.data() == data);
+        CHECK(value.size() == 100);
+    }
+
+    SUBCASE("copies the value of a shared object") {
+        copy_on_write<std::vector<int>> cow1(std::vector<int>(100, 1));
+        copy_on_write<std::vector<int>> cow2(cow1);
+
+        std::vector<int> value = std::move(cow2).extract();
+
+        CHECK(value.data() != cow1->data());
+        CHECK(value == *cow1);
+        CHECK(cow1.unique());
+    }
+
+    SUBCASE("a throwing copy leaves the object unchanged") {
+        copy_on_write<fragile> cow1(fragile(1));
+        copy_on_write<fragile> cow2(cow1);
+        fragile::copies_until_throw = 1;
+
+        CHECK_THROWS_AS((void)std::move(cow2).extract(), std::runtime_error);
+        CHECK(cow1.identity(cow2));
+    }
+
+    SUBCASE("reports the release to the observer") {
+        recording_observer::events = {};
+        copy_on_write<std::string, stlab::instrumented<recording_observer>> cow1(
+            std::string("hello"));
+        copy_on_write<std::string, stlab::instrumented<recording_observer>> cow2(cow1);
+
+        (void)std::move(cow2).extract();
+        CHECK(recording_observer::events.detach == 1);
+        (void)std::move(cow1).extract();
+        CHECK(recording_observer::events.destroy == 1);
+    }
+}
+
+TEST_CASE("copy_on_write conditional write") {
+    copy_on_write<std::string> x(std::string("hello"));
+
+    SUBCASE("try_write writes a unique value in place") {
+        const std::string* before = &x.read();
+        CHECK(x.try_write([](std::string& s) { s += '!'; }));
+        CHECK(*x == "hello!");
+        CHECK(&x.read() == before);
+    }
+
+    SUBCASE("try_write does not copy a shared value") {
+        copy_on_write<std::string> y(x);
+        bool called = false;
+        CHECK_FALSE(x.try_write([&](std::string&) { called = true; }));
+        CHECK_FALSE(called);
+        CHECK(x.identity(y));
+        CHECK(*x == "hello");
+    }
+
+    SUBCASE("write_if skips the write when the predicate is false") {
+        copy_on_write<std::string> y(x);
+        auto has_upper = [](const std::string& s) {
+            return std::any_of(s.begin(), s.end(), [](char c) { return c >= 'A' && c <= 'Z'; });
+        };
+        auto lower = [](std::string& s) {
+            for (char& c : s) c = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        };
+
+        CHECK_FALSE(x.write_if(has_upper, lower));
+        CHECK(x.identity(y));
+
+        x = std::string("Hello");
+        y = x;
+        CHECK(x.write_if(has_upper, lower));
+        CHECK(*x == "hello");
+        CHECK(*y == "Hello");
+    }
+
+    SUBCASE("arrays") {
+        copy_on_write<int[]> a{1, 2, 3};
+        CHECK(a.try_write([](int* p) { p[0] = 4; }));
+        CHECK(a[0] == 4);
+
+        copy_on_write<int[]> b(a);
+        CHECK_FALSE(a.try_write([](int*) {}));
+        CHECK(a.write_if([](const int* p) { return p[1] == 2; }, [](int* p) { p[1] = 5; }));
+        CHECK(a[1] == 5);
+        CHECK(b[1] == 2);
+    }
+}
+
+TEST_CASE("copy_on_write cached_hash") {
+    using cached = copy_on_write<std::string, stlab::cached_hash<counting_hash>>;
+
+    SUBCASE("the hash is computed once") {
+        counting_hash::calls = 0;
+        cached cow1(std::string("hello"));
+        cached cow2(cow1);
+
+        CHECK(cow1.hash() == std::hash<std::string>()("hello"));
+        CHECK(cow2.hash() == cow1.hash());
+        CHECK(std::hash<cached>()(cow1) == cow1.hash());
+        CHECK(counting_hash::calls == 1);
+    }
+
+    SUBCASE("writing invalidates the hash") {
+        cached cow1(std::string("hello"));
+        cached cow2(cow1);
+        (void)cow1.hash();
+
+        cow2.write() += "!";
+        CHECK(cow2.hash() == std::hash<std::string>()("hello!"));
+        cow2.write() += "!";
+        CHECK(cow2.hash() == std::hash<std::string>()("hello!!"));
+        cow2 = std::string("world");
+        CHECK(cow2.hash() == std::hash<std::string>()("world"));
+        CHECK(cow1.hash() == std::hash<std::string>()("hello"));
+    }
+
+    SUBCASE("hashing while a written value is modified") {
+        cached cow(std::string("hello"));
+        std::string& value = cow.write();
+        (void)cow.hash();
+        value += "!";
+        CHECK(cow.hash() == std::hash<std::string>()("hello!"));
+
+        // Once the value is shared it can no longer be modified, and the hash is stored.
+        cached copy(cow);
+        counting_hash::calls = 0;
+        CHECK(cow.hash() == std::hash<std::string>()("hello!"));
+        CHECK(copy.hash() == cow.hash());
+        CHECK(counting_hash::calls == 1);
+    }
+
+    SUBCASE("std::hash is disabled for values that cannot be hashed") {
+        struct unhashable {};
+        using cow = copy_on_write<unhashable>;
+        CHECK(!std::is_invocable_v<std::hash<cow>, const cow&>);
+        CHECK(!std::is_default_constructible_v<std::hash<cow>>);
+        CHECK(std::is_invocable_v<std::hash<cached>, const cached&>);
+        CHECK(std::is_invocable_v<std::hash<copy_on_write<int>>, const copy_on_write<int>&>);
+    }
+
+    SUBCASE("equality rejects values with different hashes") {
+        cached cow1(std::string("hello"));
+        cached cow2(std::string("world"));
+        cached cow3(std::string("hello"));
+
+        CHECK(cow1 != cow2);
+        (void)cow1.hash();
+        (void)cow2.hash();
+        (void)cow3.hash();
+        CHECK(cow1 != cow2);
+        CHECK(cow1 == cow3);
+    }
+
+    SUBCASE("uncached objects hash their value") {
+        copy_on_write<std::string> cow(std::string("hello"));
+        CHECK(std::hash<copy_on_write<std::string>>()(cow) == std::hash<std::string>()("hello"));
+    }
+}
+
+TEST_CASE("copy_on_write weak_references") {
+    using cow = copy_on_write<std::string, stlab::weak_references>;
+    using weak = stlab::weak_copy_on_write<std::string, stlab::weak_references>;
+
+    SUBCASE("weak references do not count toward unique") {
+        cow x(std::string("hello"));
+        weak w(x);
+        CHECK(x.unique());
+        CHECK(x.use_count() == 1);
+    }
+
+    SUBCASE("writing a value weak references refer to expires them") {
+        cow x(std::string("hello"));
+        weak w(x);
+        x.write() += "!";
+        CHECK(w.expired());
+        CHECK(*x == "hello!");
+        CHECK(x.unique());
+
+        weak v(x);
+        CHECK(x.try_write([](std::string& s) { s += "?"; }));
+        CHECK(v.expired());
+        CHECK(*x == "hello!?");
+
+        weak u(x);
+        x = std::string("world");
+        CHECK(u.expired());
+
+        // Without weak references the value is written in place.
+        const std::string* value = &x.read();
+        x.write() += "!";
+        CHECK(&x.read() == value);
+    }
+
+    SUBCASE("lock shares the value while it is alive") {
+        cow x(std::string("hello"));
+        weak w(x);
+        CHECK_FALSE(w.expired());
+
+        auto locked = w.lock();
+        REQUIRE(locked);
+        CHECK(locked->identity(x));
+        CHECK_FALSE(x.unique());
+    }
+
+    SUBCASE("references expire with the last copy_on_write") {
+        weak w;
+        CHECK(w.expired());
+        CHECK_FALSE(w.lock());
+        {
+            cow x(std::string(100, 'a'));
+            cow y(x);
+            w = weak(y);
+        }
+        CHECK(w.expired());
+        CHECK_FALSE(w.lock());
+
+        weak copy(w);
+        CHECK(copy.expired());
+    }
+
+    SUBCASE("default constructed values never expire") {
+        cow x;
+        weak w(x);
+        CHECK_FALSE(w.expired());
+        CHECK(w.lock());
+    }
+
+    SUBCASE("without weak references the model is unchanged") {
+        CHECK(sizeof(copy_on_write<int>) == sizeof(void*));
+        CHECK(std::is_same_v<cow::weak_type, weak>);
+    }
+}
+
+TEST_CASE("copy_on_write weak_references cache") {
+    using cow = copy_on_write<std::string, stlab::weak_references>;
+    using weak = cow::weak_type;
+
+    SUBCASE("weak keys are ordered and hashed by the value they refer to") {
+        cow x(std::string("hello"));
+        cow y(x);
+        cow z(std::string("hello"));
+        weak w(x);
+
+        CHECK(w.owner_equal(y));
+        CHECK(x.owner_equal(w));
+        CHECK_FALSE(w.owner_equal(z));
+        CHECK(w.owner_hash() == y.owner_hash());
+        CHECK(stlab::owner_less()(x, z) != stlab::owner_less()(z, x));
+        CHECK_FALSE(stlab::owner_less()(w, y));
+        CHECK_FALSE(stlab::owner_less()(y, w));
+        CHECK(w.use_count() == 2);
+    }
+
+    SUBCASE("a memoization cache does not hold its keys") {
+        std::map<weak, std::size_t, stlab::owner_less> ordered;
+        std::unordered_map<weak, std::size_t, stlab::owner_hash, stlab::owner_equal> unordered;
+        weak expired;
+        {
+            cow x(std::string(1000, 'a'));
+            ordered.emplace(x, x->size());
+            unordered.emplace(x, x->size());
+            expired = weak(x);
+
+            CHECK(x.unique());
+            CHECK(ordered.find(x) != ordered.end());
+            CHECK(unordered.find(weak(x)) != unordered.end());
+        }
+
+        CHECK(expired.expired());
+        CHECK(ordered.begin()->first.expired());
+        CHECK(ordered.count(expired) == 1);
+        CHECK(unordered.count(expired) == 1);
+
+        expired.reset();
+        CHECK(expired.use_count() == 0);
+    }
+
+    SUBCASE("writing a cached key misses the cache") {
+        std::map<weak, std::size_t, stlab::owner_less> ordered;
+        std::unordered_map<weak, std::size_t, stlab::owner_hash, stlab::owner_equal> unordered;
+        cow x(std::string(1000, 'a'));
+        ordered.emplace(x, x->size());
+        unordered.emplace(x, x->size());
+        weak key(x);
+
+        REQUIRE(x.unique());
+        x.write().push_back('b');
+
+        CHECK(ordered.find(x) == ordered.end());
+        CHECK(unordered.find(weak(x)) == unordered.end());
+        CHECK(key.expired());
+        CHECK_FALSE(key.lock());
+        CHECK(ordered.begin()->first.expired());
+    }
+}
+
+TEST_CASE("copy_on_write recycled_models") {
+    // Each subcase uses its own pool, as the pool of a type outlives the subcase.
+    SUBCASE("write reuses a released model and its buffer") {
+        using pooled = copy_on_write<std::vector<int>, stlab::recycled_models<2>>;
+        pooled a(std::vector<int>(1000, 1));
+        const int* buffer = nullptr;
+        {
+            pooled released(std::vector<int>(1000, 2));
+            buffer = released->data();
+        }
+
+        pooled b = a;
+        b.write()[0] = 3;
+        CHECK(b->data() == buffer);
+        CHECK((*b)[0] == 3);
+        CHECK((*b)[1] == 1);
+        CHECK((*a)[0] == 1);
+        CHECK(b.unique());
+        CHECK(a.unique());
+    }
+
+    SUBCASE("assignment to a shared instance reuses a released model") {
+        using pooled = copy_on_write<std::vector<int>, stlab::recycled_models<3>>;
+        const std::vector<int> value(1000, 4);
+        pooled a(value);
+        const int* buffer = nullptr;
+        {
+            pooled released(std::vector<int>(1000, 5));
+            buffer = released->data();
+        }
+
+        pooled b = a;
+        b = value;
+        CHECK(b->data() == buffer);
+        CHECK(*b == value);
+        CHECK(!b.identity(a));
+        CHECK(b.unique());
+    }
+
+    SUBCASE("the pool is bounded and released at thread exit") {
+        using pooled_counted = copy_on_write<counted, stlab::recycled_models<2>>;
+
+        std::thread([] {
+            {
+                std::vector<pooled_counted> values;
+                for (int i = 0; i != 4; ++i) values.emplace_back(counted());
+                CHECK(counted::live == 4);
+            }
+            CHECK(counted::live == 2);
+
+            pooled_counted a{counted()};
+            CHECK(counted::live == 3);
+            pooled_counted b = a;
+            b.write();
+            CHECK(counted::live == 3);
+        }).join();
+        CHECK(counted::live == 0);
+    }
+
+    SUBCASE("a value released after the pool is destroyed is not pooled") {
+        using pooled_counted = copy_on_write<counted, stlab::recycled_models<4>>;
+
+        std::thread([] {
+            // Constructed before the pool, so destroyed after it when the thread exits.
+            thread_local pooled_counted late{counted()};
+            pooled_counted a{counted()};
+            pooled_counted b = a;
+            b.write();
+            CHECK(counted::live == 3);
+        }).join();
+        CHECK(counted::live == 0);
+    }
+}
+
+TEST_CASE("copy_on_write bitwise_compare") {
+    SUBCASE("contiguous ranges") {
+        using bytes = copy_on_write<std::vector<std::uint8_t>, stlab::bitwise_compare>;
+        std::vector<std::uint8_t> value(10000, 7);
+        bytes a(value);
+        bytes b(value);
+        CHECK(a == b);
+        CHECK(!(a < b));
+        CHECK(a == value);
+
+        b.write()[9000] = 8;
+        CHECK(a != b);
+        CHECK(a < b);
+        CHECK(!(b < a));
+
+        b.write().pop_back();
+        CHECK(b.read().size() < a.read().size());
+        CHECK(a < b); // the first difference decides, not the size
+
+        bytes prefix(std::vector<std::uint8_t>(value.begin(), value.begin() + 100));
+        CHECK(prefix < a);
+        CHECK(!(a < prefix));
+    }
+
+    SUBCASE("ordering matches the value type") {
+        using ints = copy_on_write<std::vector<int>, stlab::bitwise_compare>;
+        ints a(std::vector<int>{1, 2, -1});
+        ints b(std::vector<int>{1, 2, 256});
+        CHECK(a < b); // byte order would put -1 after 256
+        CHECK((a < b) == (a.read() < b.read()));
+
+        using strings = copy_on_write<std::string, stlab::bitwise_compare>;
+        strings x(std::string("ab\xff"));
+        strings y(std::string("ab\x01"));
+        CHECK((x < y) == (x.read() < y.read()));
+        CHECK(x != y);
+        CHECK(x == std::string("ab\xff"));
+    }
+
+    SUBCASE("values with unique object representations") {
+        struct pair {
+            std::int32_t a;
+            std::int32_t b;
+            auto operator<(const pair& x) const -> bool { return a < x.a; }
+        };
+        static_assert(std::has_unique_object_representations_v<pair>);
+
+        copy_on_write<pair, stlab::bitwise_compare> x(pair{1, 2});
+        copy_on_write<pair, stlab::bitwise_compare> y(pair{1, 3});
+        CHECK(x != y);
+        CHECK(!(x < y));
+        y.write().b = 2;
+        CHECK(x == y);
+    }
+
+    SUBCASE("arrays") {
+        copy_on_write<std::uint16_t[], stlab::bitwise_compare> a(5000, 3);
+        copy_on_write<std::uint16_t[], stlab::bitwise_compare> b(5000, 3);
+        CHECK(a == b);
+        b.write()[4999] = 2;
+        CHECK(a != b);
+        CHECK(b < a);
+    }
+}
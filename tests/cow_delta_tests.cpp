@@ -0,0 +1,114 @@
+#include <stlab/cow_delta.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using stlab::cow_delta;
+
+namespace {
+
+using document = std::vector<std::string>;
+
+// Replaces one line of a document.
+struct set_line {
+    std::size_t _line;
+    std::string _text;
+
+    void operator()(document& d) const {
+        if (_text == "throw") throw std::runtime_error("set_line");
+        d[_line] = _text;
+    }
+};
+
+using text = cow_delta<document, set_line, 4>;
+
+// Resolves a line from the patches, newest first, then the base document.
+auto line(const text& t, std::size_t n) -> const std::string& {
+    const auto& patches = t.patches();
+    for (auto p = patches.rbegin(); p != patches.rend(); ++p) {
+        if (p->_line == n) return p->_text;
+    }
+    return t.base()[n];
+}
+
+} // namespace
+
+TEST_CASE("cow_delta write") {
+    text t1(stlab::copy_on_write<document>(document(100, "line")));
+
+    SUBCASE("unique writes are applied in place") {
+        const document* before = &t1.base();
+        t1.write({1, "one"});
+        CHECK(t1.compacted());
+        CHECK(&t1.base() == before);
+        CHECK(t1.base()[1] == "one");
+    }
+
+    SUBCASE("shared writes record patches without copying") {
+        text t2(t1);
+        t2.write({1, "one"});
+        t2.write({2, "two"});
+
+        CHECK(&t2.base() == &t1.base());
+        CHECK(t2.patches().size() == 2);
+        CHECK(line(t2, 1) == "one");
+        CHECK(line(t2, 3) == "line");
+        CHECK(t1.compacted());
+        CHECK(t1.read()[1] == "line");
+
+        SUBCASE("read compacts the chain") {
+            CHECK(t2.read()[2] == "two");
+            CHECK(t2.compacted());
+            CHECK(&t2.base() != &t1.base());
+        }
+
+        SUBCASE("the chain is compacted at the threshold") {
+            t2.write({3, "three"});
+            t2.write({1, "uno"});
+            CHECK(t2.compacted());
+            CHECK(t2.base()[1] == "uno");
+            CHECK(t2.base()[3] == "three");
+            CHECK(t1.base()[1] == "line");
+        }
+
+        SUBCASE("a copy of a patched value shares the chain") {
+            text t3(t2);
+            CHECK(t3.identity(t2));
+            t3.write({4, "four"});
+            CHECK(t3.patches().size() == 3);
+            CHECK(t2.patches().size() == 2);
+            CHECK(line(t3, 1) == "one");
+        }
+
+        SUBCASE("the chain is applied in place once the base is unique") {
+            t1 = text();
+            const document* before = &t2.base();
+            t2.compact();
+            CHECK(&t2.base() == before);
+            CHECK(t2.base()[2] == "two");
+        }
+
+        SUBCASE("a throwing patch leaves a shared value unchanged") {
+            t2.write({5, "throw"});
+            CHECK_THROWS_AS(t2.compact(), std::runtime_error);
+            CHECK(t2.patches().size() == 3);
+            CHECK(&t2.base() == &t1.base());
+        }
+    }
+
+    SUBCASE("write() compacts and detaches") {
+        text t2(t1);
+        t2.write({1, "one"});
+        t2.write()[2] = "two";
+        CHECK(t2.compacted());
+        CHECK(t2.base()[1] == "one");
+        CHECK(t2.base()[2] == "two");
+        CHECK(t1.base()[2] == "line");
+    }
+}
@@ -0,0 +1,105 @@
+#include <stlab/cow_intern_table.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+using stlab::copy_on_write;
+
+namespace {
+
+using interned = copy_on_write<std::string, stlab::weak_references>;
+
+} // namespace
+
+TEST_CASE("cow_intern_table intern") {
+    stlab::cow_intern_table<interned> table;
+
+    SUBCASE("equal values share a single value") {
+        interned a = table.intern(std::string(1000, 'a'));
+        interned b = table.intern(interned(std::string(1000, 'a')));
+        interned c = table.intern(std::string(1000, 'b'));
+
+        CHECK(a.identity(b));
+        CHECK_FALSE(a.identity(c));
+        CHECK(*a == std::string(1000, 'a'));
+        CHECK(table.size() == 2);
+    }
+
+    SUBCASE("interning an object returns it if no equal value is interned") {
+        interned x(std::string("hello"));
+        CHECK(table.intern(x).identity(x));
+        CHECK(table.intern(std::string("hello")).identity(x));
+    }
+
+    SUBCASE("entries expire with their last user") {
+        {
+            interned a = table.intern(std::string("hello"));
+            CHECK(table.intern(std::string("hello")).identity(a));
+        }
+        interned b = table.intern(std::string("world"));
+        table.purge();
+        CHECK(table.size() == 1);
+
+        interned c = table.intern(std::string("hello"));
+        CHECK(*c == "hello");
+        CHECK(table.size() == 2);
+    }
+
+    SUBCASE("writing an interned value removes it from the table") {
+        interned a = table.intern(std::string("hello"));
+        a.write() = "world";
+        table.purge();
+        CHECK(table.size() == 0);
+
+        interned b = table.intern(std::string("hello"));
+        CHECK(*b == "hello");
+        CHECK_FALSE(b.identity(a));
+    }
+
+    SUBCASE("expired entries are purged as the table grows") {
+        for (int n = 0; n != 1000; ++n) (void)table.intern(std::to_string(n));
+        CHECK(table.size() < 100);
+    }
+}
+
+TEST_CASE("cow_intern_table concurrent intern") {
+    stlab::cow_intern_table<interned> table;
+    std::vector<interned> results(8);
+    std::vector<std::thread> threads;
+
+    for (std::size_t n = 0; n != results.size(); ++n) {
+        threads.emplace_back([&, n] {
+            for (int i = 0; i != 100; ++i) (void)table.intern(std::to_string(i));
+            results[n] = table.intern(std::string("shared"));
+        });
+    }
+    for (auto& e : threads) e.join();
+
+    for (const auto& e : results) CHECK(e.identity(results[0]));
+}
+
+TEST_CASE("cow_intern_table concurrent intern and write") {
+    stlab::cow_intern_table<interned> table;
+    const std::string value(100, 'a');
+    bool changed = false;
+
+    std::thread writer([&] {
+        for (int i = 0; i != 1000; ++i) {
+            interned x = table.intern(std::string(value));
+            x.write()[0] = 'b';
+        }
+    });
+    for (int i = 0; i != 1000; ++i) {
+        interned x = table.intern(std::string(value));
+        changed = changed || *x != value;
+    }
+    writer.join();
+
+    CHECK_FALSE(changed);
+    CHECK(*table.intern(std::string(value)) == value);
+}
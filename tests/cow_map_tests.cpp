@@ -0,0 +1,140 @@
+#include <stlab/cow_map.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using stlab::cow_map;
+
+namespace {
+
+// A hash with few distinct values, to exercise nodes of keys with equal hashes.
+struct poor_hash {
+    auto operator()(int x) const noexcept -> std::size_t { return static_cast<std::size_t>(x % 3); }
+};
+
+} // namespace
+
+TEST_CASE("cow_map construction") {
+    SUBCASE("default construction is empty") {
+        cow_map<int, int> m1;
+        cow_map<int, int> m2;
+        CHECK(m1.empty());
+        CHECK(m1.size() == 0);
+        CHECK(m1.begin() == m1.end());
+        CHECK(m1.identity(m2));
+        CHECK_FALSE(m1.contains(0));
+    }
+
+    SUBCASE("initializer list construction") {
+        cow_map<std::string, int> m{{"a", 1}, {"b", 2}, {"a", 3}};
+        CHECK(m.size() == 2);
+        CHECK(m.at("a") == 1);
+        CHECK(m.at("b") == 2);
+        CHECK_THROWS_AS((void)m.at("c"), std::out_of_range);
+    }
+}
+
+TEST_CASE("cow_map insert and erase") {
+    cow_map<int, int> m;
+    std::map<int, int> expected;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> keys(0, 2000);
+
+    for (int n = 0; n != 5000; ++n) {
+        const int key = keys(generator);
+        switch (n % 3) {
+            case 0:
+                CHECK(m.insert({key, n}) == expected.insert({key, n}).second);
+                break;
+            case 1:
+                CHECK(m.insert_or_assign(key, n) == expected.insert_or_assign(key, n).second);
+                break;
+            default:
+                CHECK(m.erase(key) == expected.erase(key));
+        }
+    }
+
+    CHECK(m.size() == expected.size());
+    std::size_t visited = 0;
+    for (const auto& e : m) {
+        CHECK(expected.at(e.first) == e.second);
+        ++visited;
+    }
+    CHECK(visited == expected.size());
+    for (const auto& e : expected) CHECK(m.at(e.first) == e.second);
+}
+
+TEST_CASE("cow_map structural sharing") {
+    cow_map<int, std::string> m1;
+    for (int n = 0; n != 1000; ++n) m1.insert({n, std::to_string(n)});
+    cow_map<int, std::string> m2(m1);
+
+    CHECK(m1.identity(m2));
+
+    SUBCASE("insert copies only the path to the element") {
+        const std::string* untouched = &m1.find(0)->second;
+        CHECK(m2.insert({1000, "1000"}));
+
+        CHECK_FALSE(m1.identity(m2));
+        CHECK(m1.size() == 1000);
+        CHECK(m2.size() == 1001);
+        CHECK_FALSE(m1.contains(1000));
+        CHECK(m2.at(1000) == "1000");
+
+        std::size_t shared = 0;
+        for (int n = 0; n != 1000; ++n) shared += &m1.find(n)->second == &m2.find(n)->second;
+        CHECK(shared > 900);
+        CHECK(&m1.find(0)->second == untouched);
+    }
+
+    SUBCASE("erase leaves the copy unchanged") {
+        CHECK(m2.erase(500) == 1);
+        CHECK(m2.erase(500) == 0);
+        CHECK(m1.at(500) == "500");
+        CHECK_FALSE(m2.contains(500));
+        CHECK(m1 != m2);
+        m2.insert({500, "500"});
+        CHECK(m1 == m2);
+    }
+
+    SUBCASE("failed insert and erase copy nothing") {
+        CHECK_FALSE(m2.insert({0, "zero"}));
+        CHECK(m2.erase(-1) == 0);
+        CHECK(m1.identity(m2));
+    }
+
+    SUBCASE("unique maps are modified in place") {
+        m2.insert_or_assign(1, "one");
+        const std::string* element = &m2.find(0)->second;
+        m2.insert_or_assign(2, "two");
+        CHECK(&m2.find(0)->second == element);
+        CHECK(m1.at(1) == "1");
+    }
+
+    SUBCASE("clear") {
+        m2.clear();
+        CHECK(m2.empty());
+        CHECK(m1.size() == 1000);
+    }
+}
+
+TEST_CASE("cow_map equal hashes") {
+    cow_map<int, int, poor_hash> m;
+    for (int n = 0; n != 30; ++n) CHECK(m.insert({n, n}));
+    CHECK(m.size() == 30);
+    for (int n = 0; n != 30; ++n) CHECK(m.at(n) == n);
+
+    cow_map<int, int, poor_hash> copy(m);
+    for (int n = 0; n != 30; n += 2) CHECK(m.erase(n) == 1);
+    CHECK(m.size() == 15);
+    for (int n = 0; n != 30; ++n) CHECK(m.contains(n) == (n % 2 == 1));
+    CHECK(copy.size() == 30);
+    for (int n = 0; n != 30; ++n) CHECK(copy.at(n) == n);
+}
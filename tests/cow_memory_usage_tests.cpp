@@ -0,0 +1,101 @@
+#include <stlab/cow_memory_usage.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+using stlab::copy_on_write;
+using stlab::cow_memory;
+using stlab::memory_usage;
+
+namespace {
+
+auto string_size(const std::string& x) -> std::size_t { return sizeof(x) + x.capacity(); }
+
+} // namespace
+
+TEST_CASE("use_count") {
+    copy_on_write<std::string> x(std::string("value"));
+    CHECK(x.use_count() == 1);
+    auto y = x;
+    CHECK(x.use_count() == 2);
+    CHECK(y.use_count() == 2);
+    y.write() += "!";
+    CHECK(x.use_count() == 1);
+    CHECK(y.use_count() == 1);
+
+    copy_on_write<int> z;
+    CHECK(z.use_count() == std::numeric_limits<std::size_t>::max());
+
+    copy_on_write<int[]> a(3, 1);
+    auto b = a;
+    CHECK(a.use_count() == 2);
+}
+
+TEST_CASE("memory_usage") {
+    copy_on_write<int> a(1);
+    copy_on_write<int> b(2);
+    copy_on_write<int> c(3);
+    std::vector<copy_on_write<int>> set{a, a, b, copy_on_write<int>(4)};
+    a = copy_on_write<int>(5);
+
+    // The first value is only referred to by the set, the second is also referred to by b.
+    CHECK(memory_usage(set.begin(), set.end()) ==
+          cow_memory{3 * sizeof(int), 2 * sizeof(int), sizeof(int)});
+
+    b = copy_on_write<int>(6);
+    CHECK(memory_usage(set.begin(), set.end()) == cow_memory{3 * sizeof(int), 3 * sizeof(int), 0});
+
+    CHECK(memory_usage(set.begin(), set.begin()) == cow_memory{});
+
+    std::vector<copy_on_write<int>> defaults(2);
+    CHECK(memory_usage(defaults.begin(), defaults.end()) ==
+          cow_memory{sizeof(int), 0, sizeof(int)});
+}
+
+TEST_CASE("memory_usage size function") {
+    const std::string big(1000, 'x');
+    copy_on_write<std::string> a(big);
+    copy_on_write<std::string> b(std::string("small"));
+
+    std::vector<copy_on_write<std::string>> older{a, b};
+    std::vector<copy_on_write<std::string>> newer{a, copy_on_write<std::string>(big)};
+
+    const cow_memory o = memory_usage(older.begin(), older.end(), string_size);
+    const cow_memory n = memory_usage(newer.begin(), newer.end(), string_size);
+    CHECK(o.total == string_size(big) + string_size("small"));
+    CHECK(n.total == 2 * string_size(big));
+    CHECK(o.total == o.unique + o.shared);
+
+    a = copy_on_write<std::string>();
+    b = copy_on_write<std::string>();
+
+    // Dropping the newer state frees more memory, as the older shares its large value.
+    const cow_memory o2 = memory_usage(older.begin(), older.end(), string_size);
+    const cow_memory n2 = memory_usage(newer.begin(), newer.end(), string_size);
+    CHECK(o2.unique == string_size("small"));
+    CHECK(n2.unique == string_size(big));
+    CHECK(n2.shared == string_size(big));
+}
+
+TEST_CASE("memory_usage of arrays") {
+    copy_on_write<double[]> a(1000, 1.0);
+    copy_on_write<double[]> b(10, 2.0);
+    std::vector<copy_on_write<double[]>> set{a, a, b};
+    a = copy_on_write<double[]>();
+
+    CHECK(memory_usage(set.begin(), set.end()) ==
+          cow_memory{1010 * sizeof(double), 1000 * sizeof(double), 10 * sizeof(double)});
+
+    const auto with_header = [](const double*, std::size_t n) { return 64 + n * sizeof(double); };
+    CHECK(memory_usage(set.begin(), set.end(), with_header).total == 128 + 1010 * sizeof(double));
+
+    CHECK(set[0].owner_equal(set[1]));
+    CHECK(!set[0].owner_equal(b));
+    CHECK(set[0].owner_hash() == set[1].owner_hash());
+    CHECK(set[0].owner_before(b) != b.owner_before(set[0]));
+}
@@ -0,0 +1,135 @@
+#include <stlab/cow_serialization.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using stlab::copy_on_write;
+using stlab::cow_reader;
+using stlab::cow_writer;
+
+namespace {
+
+using line = copy_on_write<std::string>;
+using document = copy_on_write<std::vector<line>>;
+
+void save_line(std::ostream& out, const std::string& x) {
+    out << x.size() << ' ';
+    out.write(x.data(), static_cast<std::streamsize>(x.size()));
+}
+
+auto load_line(std::istream& in) -> std::string {
+    std::size_t n = 0;
+    in >> n;
+    in.get();
+    std::string result(n, '\0');
+    in.read(result.data(), static_cast<std::streamsize>(n));
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("cow_writer shares values") {
+    std::stringstream stream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+
+    const std::string big(1000, 'x');
+    line a(big);
+    line b(std::string("b"));
+    std::vector<line> history{a, a, b, a, b, line(big)};
+
+    cow_writer<line> writer(stream);
+    for (const auto& e : history) writer.write(e, save_line);
+    CHECK(writer.count() == 6);
+    CHECK(writer.unique_count() == 3);
+    CHECK(stream.str().size() < 3 * big.size());
+
+    cow_reader<line> reader(stream);
+    std::vector<line> restored;
+    for (std::size_t i = 0; i != history.size(); ++i) restored.push_back(reader.read(load_line));
+    CHECK(reader.unique_count() == 3);
+
+    for (std::size_t i = 0; i != history.size(); ++i) {
+        CHECK(*restored[i] == *history[i]);
+        for (std::size_t j = 0; j != history.size(); ++j) {
+            CHECK(restored[i].identity(restored[j]) == history[i].identity(history[j]));
+        }
+    }
+
+    CHECK_THROWS_AS(reader.read(load_line), std::ios_base::failure);
+}
+
+TEST_CASE("cow_writer nested values") {
+    std::stringstream stream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+
+    line title(std::string("title"));
+    line body(std::string("body"));
+    document first(std::vector<line>{title, body});
+    document second = first;
+    document third(std::vector<line>{title, line(std::string("edited"))});
+
+    {
+        cow_writer<line> lines(stream);
+        cow_writer<document> documents(stream);
+        auto save = [&](std::ostream& out, const std::vector<line>& x) {
+            out << x.size() << ' ';
+            for (const auto& e : x) lines.write(e, save_line);
+        };
+        for (const auto& e : {first, second, third}) documents.write(e, save);
+        CHECK(documents.unique_count() == 2);
+        CHECK(lines.unique_count() == 3);
+    }
+
+    cow_reader<line> lines(stream);
+    cow_reader<document> documents(stream);
+    auto load = [&](std::istream& in) {
+        std::size_t n = 0;
+        in >> n;
+        in.get();
+        std::vector<line> result;
+        for (std::size_t i = 0; i != n; ++i) result.push_back(lines.read(load_line));
+        return result;
+    };
+    auto x = documents.read(load);
+    auto y = documents.read(load);
+    auto z = documents.read(load);
+
+    CHECK(x.identity(y));
+    CHECK(!x.identity(z));
+    CHECK((*x)[0].identity((*z)[0]));
+    CHECK(*(*z)[1] == "edited");
+    CHECK(*(*x)[1] == "body");
+}
+
+TEST_CASE("cow_writer trivially copyable values") {
+    std::stringstream stream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+
+    copy_on_write<int> a(42);
+    copy_on_write<int> b(7);
+
+    cow_writer<copy_on_write<int>> writer(stream);
+    writer.write(a);
+    writer.write(b);
+    writer.write(a);
+
+    cow_reader<copy_on_write<int>> reader(stream);
+    auto x = reader.read();
+    auto y = reader.read();
+    auto z = reader.read();
+    CHECK(*x == 42);
+    CHECK(*y == 7);
+    CHECK(x.identity(z));
+    CHECK(!x.identity(y));
+}
+
+TEST_CASE("cow_reader malformed stream") {
+    std::stringstream stream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    stream.put(5);
+
+    cow_reader<copy_on_write<int>> reader(stream);
+    CHECK_THROWS_AS(reader.read(), std::ios_base::failure);
+}
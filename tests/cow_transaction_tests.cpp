@@ -0,0 +1,186 @@
+#include <stlab/cow_transaction.hpp>
+#include <stlab/inline_copy_on_write.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using stlab::copy_on_write;
+using stlab::cow_transaction;
+
+namespace {
+
+struct fragile {
+    int value = 0;
+    static inline bool fail = false;
+
+    fragile() = default;
+    explicit fragile(int v) : value(v) {}
+    fragile(const fragile& x) : value(x.value) {
+        if (fail) throw std::runtime_error("copy failed");
+    }
+    auto operator=(const fragile&) -> fragile& = default;
+};
+
+// A stageable object whose first member is also stageable, at the same address.
+struct labeled {
+    copy_on_write<int> value;
+    copy_on_write<std::string> label;
+
+    [[nodiscard]] auto read() const -> const labeled& { return *this; }
+    auto write() -> labeled& { return *this; }
+
+    friend void swap(labeled& x, labeled& y) noexcept {
+        swap(x.value, y.value);
+        swap(x.label, y.label);
+    }
+};
+
+} // namespace
+
+TEST_CASE("cow_transaction commit") {
+    copy_on_write<std::string> name(std::string("untitled"));
+    copy_on_write<std::vector<int>> layers(std::vector<int>{1, 2});
+    copy_on_write<int[]> pixels(4, 0);
+    const auto snapshot = name;
+
+    cow_transaction t;
+    CHECK(t.empty());
+    t.write(name) = "document";
+    t.write(layers).push_back(3);
+    t.write(pixels)[2] = 9;
+    t.write(name) += "!";
+    CHECK(t.size() == 3);
+    CHECK(t.staged(name));
+
+    // Nothing is installed before commit, and reads in the transaction see its writes.
+    CHECK(*name == "untitled");
+    CHECK(layers->size() == 2);
+    CHECK(pixels[2] == 0);
+    CHECK(t.read(name) == "document!");
+    CHECK(t.read(layers).size() == 3);
+
+    t.commit();
+    CHECK(t.empty());
+    CHECK(*name == "document!");
+    CHECK((*layers)[2] == 3);
+    CHECK(pixels[2] == 9);
+    CHECK(*snapshot == "untitled");
+    CHECK(name.unique());
+    CHECK(layers.unique());
+}
+
+TEST_CASE("cow_transaction rollback") {
+    copy_on_write<std::string> name(std::string("untitled"));
+    copy_on_write<int> count(1);
+    const auto before = name;
+
+    {
+        cow_transaction t;
+        t.write(name) = "changed";
+        t.write(count) = 2;
+    }
+    CHECK(name.identity(before));
+    CHECK(*count == 1);
+
+    cow_transaction t;
+    t.write(count) = 3;
+    t.rollback();
+    CHECK(*count == 1);
+    CHECK(!t.staged(count));
+    CHECK(&t.read(count) == &*count);
+
+    // A transaction can be reused after rolling back.
+    t.write(count) = 4;
+    t.commit();
+    CHECK(*count == 4);
+}
+
+TEST_CASE("cow_transaction failed copy") {
+    copy_on_write<fragile> a(fragile(1));
+    copy_on_write<fragile> b(fragile(2));
+
+    cow_transaction transaction;
+    transaction.write(a).value = 10;
+
+    fragile::fail = true;
+    CHECK_THROWS_AS(transaction.write(b), std::runtime_error);
+    fragile::fail = false;
+    CHECK(transaction.size() == 1);
+    CHECK(!transaction.staged(b));
+
+    transaction.commit();
+    CHECK(a->value == 10);
+    CHECK(b->value == 2);
+}
+
+TEST_CASE("cow_transaction many stages") {
+    std::vector<copy_on_write<int>> fields;
+    for (int i = 0; i != 100; ++i) fields.emplace_back(i);
+
+    cow_transaction t;
+    for (auto& e : fields) t.write(e) += 1000;
+    for (auto& e : fields) t.write(e) += 1;
+    CHECK(t.size() == 100);
+    t.commit();
+
+    for (int i = 0; i != 100; ++i) CHECK(*fields[static_cast<std::size_t>(i)] == i + 1001);
+}
+
+TEST_CASE("cow_transaction read") {
+    std::vector<copy_on_write<std::string>> fields(1, copy_on_write<std::string>("first"));
+    for (int i = 0; i != 100; ++i) fields.emplace_back(std::to_string(i));
+
+    cow_transaction t;
+    t.write(fields[0]) += "!";
+    const std::string& first = t.read(fields[0]);
+
+    // Staging more objects grows the stages but does not move the staged value.
+    for (std::size_t n = 1; n != fields.size(); ++n) t.write(fields[n]) += "!";
+    CHECK(first == "first!");
+    CHECK(&first == &t.read(fields[0]));
+
+    t.commit();
+    CHECK(&first == &*fields[0]);
+}
+
+TEST_CASE("cow_transaction inline values") {
+    stlab::inline_copy_on_write<int> x(1);
+    std::vector<copy_on_write<int>> fields(100, copy_on_write<int>(0));
+
+    cow_transaction t;
+    int& staged = t.write(x);
+    const int& read = t.read(x);
+
+    // The staged value is stored in the stage itself, so the stage must not move.
+    for (auto& e : fields) t.write(e) = 1;
+    staged = 2;
+    CHECK(read == 2);
+    CHECK(&read == &t.read(x));
+    CHECK(*x == 1);
+
+    t.commit();
+    CHECK(*x == 2);
+    CHECK(*fields.back() == 1);
+}
+
+TEST_CASE("cow_transaction objects at the same address") {
+    labeled x{copy_on_write<int>(1), copy_on_write<std::string>("x")};
+    static_assert(sizeof(labeled) <= cow_transaction::staged_size);
+
+    cow_transaction t;
+    t.write(x).label = copy_on_write<std::string>("staged");
+    t.write(x.value) = 2;
+    CHECK(t.size() == 2);
+    CHECK(t.staged(x));
+    CHECK(t.staged(x.value));
+    CHECK(*t.read(x).label == "staged");
+    CHECK(t.read(x.value) == 2);
+
+    t.commit();
+    CHECK(*x.label == "staged");
+    CHECK(*x.value == 2);
+}
@@ -0,0 +1,180 @@
+#include <stlab/cow_vector.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using stlab::cow_vector;
+
+TEST_CASE("cow_vector construction") {
+    SUBCASE("default construction is empty") {
+        cow_vector<int> v1;
+        cow_vector<int> v2;
+        CHECK(v1.empty());
+        CHECK(v1.size() == 0);
+        CHECK(v1.begin() == v1.end());
+        CHECK(v1.identity(v2));
+    }
+
+    SUBCASE("sized construction") {
+        cow_vector<int, 4> v1(std::size_t{10});
+        CHECK(v1.size() == 10);
+        CHECK(std::all_of(v1.begin(), v1.end(), [](int x) { return x == 0; }));
+
+        cow_vector<std::string, 4> v2(9, "hello");
+        CHECK(v2.size() == 9);
+        CHECK(v2[8] == "hello");
+    }
+
+    SUBCASE("range construction") {
+        std::vector<int> source(10);
+        std::iota(source.begin(), source.end(), 0);
+        cow_vector<int, 3> v1(source.begin(), source.end());
+        cow_vector<int, 3> v2{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+        CHECK(v1.size() == 10);
+        CHECK(std::equal(v1.begin(), v1.end(), source.begin(), source.end()));
+        CHECK(v1 == v2);
+        CHECK_FALSE(v1.identity(v2));
+        CHECK(v1.front() == 0);
+        CHECK(v1.back() == 9);
+    }
+}
+
+TEST_CASE("cow_vector copy semantics") {
+    cow_vector<std::string, 2> v1{"a", "b", "c", "d", "e"};
+    cow_vector<std::string, 2> v2(v1);
+
+    CHECK(v1.identity(v2));
+
+    SUBCASE("write copies only the touched page") {
+        const std::string* untouched = &v1[0];
+        const std::string* touched = &v1[3];
+
+        v2.write(3) = "x";
+
+        CHECK_FALSE(v1.identity(v2));
+        CHECK(v1[3] == "d");
+        CHECK(v2[3] == "x");
+        CHECK(&v2[0] == untouched);
+        CHECK(&v2[4] == &v1[4]);
+        CHECK(&v2[3] != touched);
+        CHECK(&v1[3] == touched);
+    }
+
+    SUBCASE("unique writes are in place") {
+        v2.write(0) = "x";
+        const std::string* element = &v2[0];
+        v2.write(0) = "y";
+        CHECK(&v2[0] == element);
+        CHECK(v1[0] == "a");
+    }
+
+    SUBCASE("push_back and pop_back leave the source unchanged") {
+        v2.push_back("f");
+        v2.push_back("g");
+        CHECK(v2.size() == 7);
+        CHECK(v2.back() == "g");
+        CHECK(v1.size() == 5);
+        CHECK(v1.back() == "e");
+
+        v2.pop_back();
+        v2.pop_back();
+        v2.pop_back();
+        CHECK(v2.size() == 4);
+        CHECK(v2.back() == "d");
+        CHECK(v1.size() == 5);
+        CHECK(v1.back() == "e");
+    }
+
+    SUBCASE("clear") {
+        v2.clear();
+        CHECK(v2.empty());
+        CHECK(v1.size() == 5);
+    }
+}
+
+TEST_CASE("cow_vector exception safety") {
+    struct element {
+        int _value;
+
+        explicit element(int x) : _value(x) {
+            if (x < 0) throw std::runtime_error("negative element");
+        }
+
+        auto operator==(const element& x) const -> bool { return _value == x._value; }
+        auto operator!=(const element& x) const -> bool { return !(*this == x); }
+    };
+
+    cow_vector<element, 2> v;
+    v.emplace_back(0);
+    v.emplace_back(1);
+
+    SUBCASE("a throwing construction on a new page leaves the sequence unchanged") {
+        CHECK_THROWS_AS(v.emplace_back(-1), std::runtime_error);
+        CHECK(v.size() == 2);
+
+        v.emplace_back(2);
+        v.emplace_back(3);
+        v.emplace_back(4);
+        CHECK(v[3]._value == 3);
+        CHECK(v.back()._value == 4);
+
+        cow_vector<element, 2> expected;
+        for (int n = 0; n != 5; ++n) expected.emplace_back(n);
+        CHECK(v == expected);
+
+        v.pop_back();
+        v.pop_back();
+        CHECK(v.back()._value == 2);
+    }
+
+    SUBCASE("a throwing construction on the last page leaves the sequence unchanged") {
+        v.emplace_back(2);
+        CHECK_THROWS_AS(v.emplace_back(-1), std::runtime_error);
+        CHECK(v.size() == 3);
+        CHECK(v.back()._value == 2);
+    }
+}
+
+TEST_CASE("cow_vector iteration") {
+    cow_vector<int, 4> v;
+    for (int n = 0; n != 10; ++n) v.push_back(n);
+
+    CHECK(v.end() - v.begin() == 10);
+    CHECK(v.begin()[5] == 5);
+    CHECK(*(v.end() - 1) == 9);
+    CHECK(std::accumulate(v.begin(), v.end(), 0) == 45);
+
+    std::vector<int> reversed(std::make_reverse_iterator(v.end()),
+                              std::make_reverse_iterator(v.begin()));
+    CHECK(reversed.front() == 9);
+    CHECK(reversed.back() == 0);
+}
+
+TEST_CASE("cow_vector comparison") {
+    cow_vector<int, 2> v1{1, 2, 3};
+    cow_vector<int, 2> v2{1, 2, 3};
+    cow_vector<int, 2> v3{1, 2, 4};
+    cow_vector<int, 2> v4{1, 2};
+
+    CHECK(v1 == v2);
+    CHECK(v1 != v3);
+    CHECK(v1 != v4);
+    CHECK(v1 < v3);
+    CHECK(v4 < v1);
+    CHECK(v3 > v1);
+    CHECK(v1 <= v2);
+    CHECK(v1 >= v2);
+
+    swap(v1, v4);
+    CHECK(v1.size() == 2);
+    CHECK(v4.size() == 3);
+}
@@ -0,0 +1,115 @@
+#include <stlab/inline_copy_on_write.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+using stlab::copy_on_write;
+using stlab::inline_copy_on_write;
+using stlab::small_copy_on_write;
+
+namespace {
+
+struct point {
+    int x;
+    int y;
+};
+
+struct int_hash {
+    auto operator()(int x) const noexcept -> std::size_t { return static_cast<std::size_t>(x); }
+};
+
+template <class T, class = void>
+constexpr bool has_hash_v = false;
+
+template <class T>
+constexpr bool has_hash_v<T, std::void_t<decltype(std::declval<const T&>().hash())>> = true;
+
+} // namespace
+
+TEST_CASE("small_copy_on_write representation") {
+    static_assert(std::is_same_v<small_copy_on_write<int>, inline_copy_on_write<int>>);
+    static_assert(std::is_same_v<small_copy_on_write<std::array<char, 64>>,
+                                 inline_copy_on_write<std::array<char, 64>>>);
+    static_assert(std::is_same_v<small_copy_on_write<std::array<char, 65>>,
+                                 copy_on_write<std::array<char, 65>>>);
+    static_assert(std::is_same_v<small_copy_on_write<std::string>, copy_on_write<std::string>>);
+    static_assert(std::is_same_v<small_copy_on_write<int, stlab::single_threaded>,
+                                 inline_copy_on_write<int>>);
+    static_assert(std::is_same_v<small_copy_on_write<int, stlab::weak_references>,
+                                 copy_on_write<int, stlab::weak_references>>);
+    static_assert(std::is_same_v<small_copy_on_write<int, stlab::cached_hash<int_hash>>,
+                                 copy_on_write<int, stlab::cached_hash<int_hash>>>);
+    static_assert(std::is_same_v<small_copy_on_write<int, stlab::bitwise_compare>,
+                                 copy_on_write<int, stlab::bitwise_compare>>);
+    static_assert(std::is_same_v<small_copy_on_write<int, stlab::recycled_models<8>>,
+                                 copy_on_write<int, stlab::recycled_models<8>>>);
+    static_assert(
+        std::is_same_v<small_copy_on_write<int, stlab::single_threaded, std::allocator<int>>,
+                       inline_copy_on_write<int>>);
+    static_assert(sizeof(inline_copy_on_write<point>) == sizeof(point));
+    static_assert(std::is_trivially_copyable_v<inline_copy_on_write<point>>);
+}
+
+TEST_CASE("inline_copy_on_write operations") {
+    inline_copy_on_write<int> a;
+    CHECK(*a == 0);
+    CHECK(a.unique());
+
+    a = 42;
+    inline_copy_on_write<int> b(a);
+    CHECK(b.unique());
+    CHECK_FALSE(a.identity(b));
+    CHECK(a.identity(a));
+    CHECK(a == b);
+
+    b.write() = 7;
+    CHECK(*a == 42);
+    CHECK(*b == 7);
+    CHECK(b < a);
+    CHECK(b < 8);
+    CHECK(42 == a);
+
+    CHECK(a.try_write([](int& x) { ++x; }));
+    CHECK(*a == 43);
+    CHECK_FALSE(a.write_if([](int x) { return x < 0; }, [](int& x) { x = 0; }));
+    CHECK(a.write([](int x) { return x * 2; }, [](int& x) { x *= 2; }) == 86);
+
+    inline_copy_on_write<point> p(point{1, 2});
+    CHECK(p->y == 2);
+    CHECK(std::move(p).extract().x == 1);
+
+    swap(a, b);
+    CHECK(*a == 7);
+    CHECK(a.hash() == std::hash<int>()(7));
+    std::unordered_set<inline_copy_on_write<int>> set{a, b};
+    CHECK(set.size() == 2);
+
+    // point has no std::hash, so neither does inline_copy_on_write<point>.
+    static_assert(has_hash_v<inline_copy_on_write<int>>);
+    static_assert(!has_hash_v<inline_copy_on_write<point>>);
+    static_assert(!std::is_invocable_v<std::hash<inline_copy_on_write<point>>,
+                                       const inline_copy_on_write<point>&>);
+}
+
+TEST_CASE("small_copy_on_write generic use") {
+    auto twice = [](auto x) {
+        x.write() = *x + *x;
+        return x;
+    };
+
+    small_copy_on_write<int> small(1);
+    small_copy_on_write<std::string> large(std::string("a"));
+    CHECK(*twice(small) == 2);
+    CHECK(*twice(large) == "aa");
+    CHECK(*small == 1);
+    CHECK(*large == "a");
+}
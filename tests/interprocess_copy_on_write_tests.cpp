@@ -0,0 +1,140 @@
+#include <stlab/interprocess_copy_on_write.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+using stlab::cow_segment;
+using stlab::interprocess_copy_on_write;
+
+namespace {
+
+using frame = std::array<int, 256>;
+
+/*
+    Stands in for a shared memory mapping.
+*/
+struct alignas(cow_segment::alignment) region {
+    unsigned char _bytes[16 * 1024];
+};
+
+// A trivially copyable value whose constructor from an int may throw.
+struct checked {
+    int _value = 0;
+
+    checked() = default;
+    explicit checked(int x) : _value(x) {
+        if (x < 0) throw std::invalid_argument("negative value");
+    }
+};
+
+} // namespace
+
+TEST_CASE("interprocess_copy_on_write in a segment") {
+    region memory;
+    cow_segment segment = cow_segment::create(&memory, sizeof(memory));
+    const std::size_t empty = segment.available();
+
+    {
+        interprocess_copy_on_write<frame> x(segment, std::in_place, frame{1, 2, 3});
+        CHECK(x.in_segment());
+        CHECK(x.segment() == segment);
+        CHECK(x.unique());
+        CHECK((*x)[1] == 2);
+        CHECK(segment.available() < empty);
+
+        auto y = interprocess_copy_on_write<frame>::attach(segment, x.offset());
+        CHECK(y.identity(x));
+        CHECK(!x.unique());
+        CHECK(&y.read() == &x.read());
+
+        y.write()[1] = 42;
+        CHECK(!y.in_segment());
+        CHECK(y.unique());
+        CHECK(x.unique());
+        CHECK(y->at(1) == 42);
+        CHECK(x->at(1) == 2);
+        CHECK(!y.identity(x));
+    }
+
+    CHECK(segment.available() == empty);
+}
+
+TEST_CASE("interprocess_copy_on_write at a different address") {
+    region first;
+    cow_segment segment = cow_segment::create(&first, sizeof(first));
+    interprocess_copy_on_write<frame> x(segment, std::in_place, frame{7});
+    const auto offset = x.offset();
+
+    // A second process maps the same segment at another address.
+    region second;
+    std::memcpy(&second, &first, sizeof(first));
+    cow_segment other = cow_segment::open(&second);
+    CHECK(other != segment);
+    CHECK(other.size() == sizeof(second));
+
+    auto y = interprocess_copy_on_write<frame>::attach(other, offset);
+    CHECK(y->at(0) == 7);
+    CHECK(y.offset() == offset);
+    CHECK(!y.unique());
+}
+
+TEST_CASE("cow_segment allocation") {
+    region memory;
+    cow_segment segment = cow_segment::create(&memory, sizeof(memory));
+    const std::size_t empty = segment.available();
+
+    {
+        interprocess_copy_on_write<frame> a(segment, std::in_place);
+        interprocess_copy_on_write<frame> b(segment, std::in_place);
+        interprocess_copy_on_write<frame> c(segment, std::in_place);
+        CHECK(a.offset() < b.offset());
+        CHECK(b.offset() < c.offset());
+
+        // Freeing the middle block and then its neighbours merges them into one.
+        b = interprocess_copy_on_write<frame>();
+        CHECK(!b.in_segment());
+        a = interprocess_copy_on_write<frame>();
+        c = interprocess_copy_on_write<frame>(segment, std::in_place);
+    }
+    CHECK(segment.available() == empty);
+
+    using large = std::array<char, sizeof(region)>;
+    CHECK_THROWS_AS(interprocess_copy_on_write<large>(segment, std::in_place), std::bad_alloc);
+    CHECK(segment.available() == empty);
+}
+
+TEST_CASE("interprocess_copy_on_write throwing construction") {
+    region memory;
+    cow_segment segment = cow_segment::create(&memory, sizeof(memory));
+    const std::size_t empty = segment.available();
+
+    CHECK_THROWS_AS(interprocess_copy_on_write<checked>(segment, std::in_place, -1),
+                    std::invalid_argument);
+    CHECK(segment.available() == empty);
+
+    interprocess_copy_on_write<checked> x(segment, std::in_place, 1);
+    CHECK(x.in_segment());
+    CHECK(x->_value == 1);
+}
+
+TEST_CASE("interprocess_copy_on_write local values") {
+    interprocess_copy_on_write<int> x;
+    CHECK(!x.in_segment());
+    CHECK(*x == 0);
+
+    interprocess_copy_on_write<int> y(stlab::copy_on_write<int>(5));
+    auto z = y;
+    CHECK(z.identity(y));
+    z.write() = 6;
+    CHECK(*y == 5);
+    CHECK(*z == 6);
+    swap(y, z);
+    CHECK(*y == 6);
+}
@@ -0,0 +1,131 @@
+#include <stlab/lazy_copy_on_write.hpp>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using stlab::copy_on_write;
+using stlab::lazy_copy_on_write;
+
+TEST_CASE("lazy_copy_on_write builds on first access") {
+    int calls = 0;
+    auto x = lazy_copy_on_write<std::string>::lazy([&] {
+        ++calls;
+        return std::string("document");
+    });
+    CHECK(!x.materialized());
+    CHECK(x.unique());
+
+    auto y = x;
+    CHECK(y.identity(x));
+    CHECK(!x.unique());
+    CHECK(calls == 0);
+
+    CHECK(*y == "document");
+    CHECK(calls == 1);
+    CHECK(x.materialized());
+    CHECK(x->size() == 8);
+    CHECK(calls == 1);
+    CHECK(&x.read() == &y.read());
+    CHECK(x == y);
+
+    y.write() += "!";
+    CHECK(*y == "document!");
+    CHECK(*x == "document");
+    CHECK(!y.identity(x));
+    CHECK(y.unique());
+    CHECK(calls == 1);
+}
+
+TEST_CASE("lazy_copy_on_write sole owner writes in place") {
+    auto x = lazy_copy_on_write<std::vector<int>>::lazy([] { return std::vector<int>(100, 1); });
+    const int* data = x->data();
+    x.write()[0] = 2;
+    CHECK(x->data() == data);
+    CHECK(x.unique());
+
+    auto y = lazy_copy_on_write<std::vector<int>>::lazy([] { return std::vector<int>(10, 3); });
+    y.write()[0] = 4;
+    CHECK((*y)[0] == 4);
+}
+
+TEST_CASE("lazy_copy_on_write values") {
+    lazy_copy_on_write<int> x;
+    CHECK(x.materialized());
+    CHECK(*x == 0);
+
+    lazy_copy_on_write<int> y(copy_on_write<int>(5));
+    CHECK(*y == 5);
+    auto z = lazy_copy_on_write<int>::lazy([] { return 5; });
+    CHECK(!y.identity(z));
+    CHECK(y == z);
+    auto w = z;
+    swap(x, z);
+    CHECK(x.identity(w));
+    CHECK(*z == 0);
+    CHECK(*x == 5);
+    CHECK(x.get().read() == 5);
+}
+
+TEST_CASE("lazy_copy_on_write of a value that is not default constructible") {
+    struct expensive {
+        std::vector<int> data;
+        explicit expensive(std::size_t n) : data(n, 1) {}
+        auto operator==(const expensive& x) const -> bool { return data == x.data; }
+        auto operator!=(const expensive& x) const -> bool { return !(*this == x); }
+    };
+    static_assert(!std::is_default_constructible_v<expensive>);
+
+    auto x = lazy_copy_on_write<expensive>::lazy([] { return expensive(1000); });
+    auto y = x;
+    CHECK(!x.materialized());
+    CHECK(x->data.size() == 1000);
+    CHECK(y.materialized());
+
+    x.write().data.push_back(2);
+    CHECK(x->data.size() == 1001);
+    CHECK(y->data.size() == 1000);
+    CHECK(x != y);
+}
+
+TEST_CASE("lazy_copy_on_write factory failure") {
+    int attempts = 0;
+    auto x = lazy_copy_on_write<std::string>::lazy([&] {
+        if (++attempts == 1) throw std::runtime_error("failed");
+        return std::string("ok");
+    });
+    CHECK_THROWS_AS((void)x.read(), std::runtime_error);
+    CHECK(!x.materialized());
+    CHECK(*x == "ok");
+    CHECK(attempts == 2);
+}
+
+TEST_CASE("lazy_copy_on_write concurrent first access") {
+    std::atomic<int> calls{0};
+    auto x = lazy_copy_on_write<std::string>::lazy([&] {
+        ++calls;
+        return std::string(100, 'x');
+    });
+
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches{0};
+    for (int i = 0; i != 4; ++i) {
+        threads.emplace_back([copy = x, i, &mismatches]() mutable {
+            if (copy->size() != 100) ++mismatches;
+            if (i % 2) copy.write() += "y";
+        });
+    }
+    for (auto& e : threads) e.join();
+
+    CHECK(calls == 1);
+    CHECK(mismatches == 0);
+    CHECK(*x == std::string(100, 'x'));
+}